@@ -1,146 +1,3732 @@
 #include "orcLibBridge.h"
+#include "orc_cache.h"
 #include "orcInclude/ColumnPrinter.hh"
 
+extern "C" {
+#include "catalog/pg_type.h"
+#include "datatype/timestamp.h"
+#include "mb/pg_wchar.h"
+#include "miscadmin.h"
+#include "storage/fd.h"
+#include "utils/date.h"
+#include "utils/memutils.h"
+}
+
 #include <memory>
 #include <string>
 #include <iostream>
 #include <exception>
-#include <unordered_map>
+#include <stdexcept>
+#include <list>
+#include <set>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <pthread.h>
+#include <signal.h>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include <vector>
 
+/* minimum chunk the batch arena takes from its memory context */
+#define BATCH_ARENA_CHUNK_SIZE (64 * 1024)
 
-class OrcReader {
+/*
+ * MemoryContextAllocHuge() that returns NULL when out of memory. The ERROR's
+ * longjmp would skip the c++ frames above, the callers throw std::bad_alloc
+ * instead, which the wrapper functions turn into an ERROR.
+ */
+static void *allocHugeNoError(MemoryContext context, Size size) {
+#if PG_VERSION_NUM >= 90500
+    return MemoryContextAllocExtended(context, size, MCXT_ALLOC_HUGE | MCXT_ALLOC_NO_OOM);
+#else
+    /* the ERROR is caught in this frame, no c++ frame is skipped */
+    MemoryContext oldcontext = CurrentMemoryContext;
+    void *volatile result = NULL;
+
+    PG_TRY();
+    {
+        result = MemoryContextAllocHuge(context, size);
+    }
+    PG_CATCH();
+    {
+        MemoryContextSwitchTo(oldcontext);
+        FlushErrorState();
+        result = NULL;
+    }
+    PG_END_TRY();
+
+    return result;
+#endif
+}
+
+/*
+ * Bump allocator for the by-reference Datums of one row batch. It carves them
+ * from a few large chunks of the per-batch memory context, which is reset as
+ * a whole before the next batch, so converting rows never palloc()s or frees
+ * single values.
+ */
+class BatchArena {
 public:
-/*global variable*/
-    unsigned int colNum;
-    unsigned int maxRowPerBatch;
-    std::string line;
-    unsigned long curRow;
+    MemoryContext context;
+    char *freePtr;
+    char *endPtr;
 
-    orc::ReaderOptions opts;
+    BatchArena(MemoryContext batchContext) : context(batchContext), freePtr(NULL), endPtr(NULL) {}
 
-    std::unique_ptr<orc::Reader> reader;
-    std::unique_ptr<orc::ColumnVectorBatch> batch;
-    std::unique_ptr<orc::ColumnPrinter> printer;
+    /* release everything of the previous batch */
+    void reset() {
+        MemoryContextReset(context);
+        freePtr = endPtr = NULL;
+    }
 
-    /* init global var, should be used in BeginForeignScan() */
-    OrcReader(const char* filename, unsigned int fdwColNum, unsigned int fdwMaxRowPerBatch) {
-        colNum = fdwColNum;
-        curRow = 0;//don't forget
-        maxRowPerBatch = fdwMaxRowPerBatch;
+    /* make sure the next size bytes can be carved from the current chunk */
+    void reserve(uint64_t size) {
+        if ((uint64_t) (endPtr - freePtr) >= size)
+            return;
 
-        reader = orc::createReader(orc::readLocalFile(std::string(filename)), opts);
-        batch = reader->createRowBatch(maxRowPerBatch);
-        printer = createColumnPrinter(line, reader->getType());
+        size = std::max(size, (uint64_t) BATCH_ARENA_CHUNK_SIZE);
+        char *chunk = (char *) allocHugeNoError(context, size);
+        if (chunk == NULL)
+            throw std::bad_alloc();
+        freePtr = chunk;
+        endPtr = chunk + size;
+    }
+
+    char *alloc(uint64_t size) {
+        size = MAXALIGN(size);
+        reserve(size);
 
-        /* get first batch of record */
-        reader->next(*batch);
-        printer->reset(*batch);
+        char *result = freePtr;
+        freePtr += size;
+        return result;
     }
+};
 
-    ~OrcReader() {
-        orc::Reader * rd = reader.release();
-        delete rd;
+/*
+ * orc::MemoryPool on top of a per-scan memory context. The reader's decode
+ * buffers and row batches are charged to the scan, show up in
+ * MemoryContextStats() and go away in bulk when the scan ends.
+ */
+class PgMemoryPool : public orc::MemoryPool {
+public:
+    MemoryContext context;
+    uint64_t allocated;     /* bytes currently handed out */
+    uint64_t peak;          /* high-water mark of allocated */
+    bool bulkRelease;       /* context is about to go away, free() is a no-op */
+
+    PgMemoryPool(MemoryContext decodeContext)
+        : context(decodeContext), allocated(0), peak(0), bulkRelease(false) {}
+
+    /*
+     * Decompression buffers of large stripes may exceed MaxAllocSize, so all
+     * requests are huge allocations; AllocSet keeps such chunks in blocks of
+     * their own and returns them to the system on free().
+     */
+    char* malloc(uint64_t size) ORC_OVERRIDE {
+        /* don't let an out of memory ERROR longjmp through the orc lib */
+        char *p = (char *) allocHugeNoError(context, size);
+        if (p == NULL)
+            throw std::bad_alloc();
 
-        orc::ColumnVectorBatch * cvb = batch.release();
-        delete cvb;
+        allocated += GetMemoryChunkSpace(p);
+        peak = std::max(peak, allocated);
 
-        orc::ColumnPrinter * cp = printer.release();
-        delete cp;
+        return p;
     }
 
+    void free(char* p) ORC_OVERRIDE {
+        if (p == NULL || bulkRelease)
+            return;
 
-    /* iteratively get one line record.
-     * return: false means no next record.
-    * */
-    bool OrcGetNext(char **tuple) {
-        if(batch->numElements == 0)
-            return false;
+        allocated -= GetMemoryChunkSpace(p);
+        pfree(p);
+    }
+};
 
-        if(curRow == batch->numElements) {
-            if (reader->next(*batch)) {
+struct ColumnConverter;
 
-                printer->reset(*batch);
+/*
+ * converts the rows of one column of the current batch which are listed in
+ * the selection vector, output i is batch row rows[i]
+ */
+typedef void (*ColumnKernel)(ColumnConverter &converter, const uint32_t *rows, uint64_t rowCount,
+                             Datum *values, bool *nulls);
 
-                if(batch->numElements == 0)
-                    return false;
+/*
+ * How one fdw column is turned into Datums. The kernel is resolved once per
+ * column from (orc TypeKind, atttypid) in BeginForeignScan(), everything
+ * without a binary kernel goes through the ColumnPrinter text path and the
+ * column type's input function.
+ */
+struct ColumnConverter {
+    ColumnKernel kernel;
+    orc::TypeKind kind;
+    Oid typeId;
+    int32 typeMod;
+    orc::ColumnVectorBatch *vector;/* the column's field in the row batch */
+    std::unique_ptr<orc::ColumnPrinter> printer;/* only for the text fallback */
+    BatchArena *arena;/* by-reference values of the batch */
+};
 
-                curRow = 0;
-                /* my modified printRow(int rowId, char** tuple, int curColId) */
-                printer->printRow(curRow, tuple, 0);
-                curRow++;
+/* build a varlena from the string vector's buffer with a single copy */
+static Datum makeVarlena(BatchArena &arena, const char *data, int64_t len) {
+    struct varlena *result = (struct varlena *) arena.alloc(len + VARHDRSZ);
 
-                return true;
-            }
-            else
-                return false;
+    SET_VARSIZE(result, len + VARHDRSZ);
+    memcpy(VARDATA(result), data, len);
+
+    return PointerGetDatum(result);
+}
+
+/*
+ * varchar(n)/char(n) follow varcharin()/bpcharin(): values longer than n may
+ * only lose trailing blanks, char(n) is blank padded up to n.
+ */
+static Datum makeLimitedVarlena(BatchArena &arena, const char *data, int64_t len, int32 typeMod, bool blankPad) {
+    if (typeMod < (int32) VARHDRSZ)
+        return makeVarlena(arena, data, len);
+
+    int64_t maxLen = typeMod - VARHDRSZ;
+    int64_t charLen = pg_mbstrlen_with_len(data, len);
+
+    if (charLen > maxLen) {
+        int64_t clipLen = pg_mbcharcliplen(data, len, maxLen);
+
+        for (int64_t j = clipLen; j < len; j++) {
+            if (data[j] != ' ')
+                throw std::range_error("value too long for type character"
+                                       + std::string(blankPad ? "" : " varying")
+                                       + "(" + std::to_string(maxLen) + ")");
         }
-        else {/*curRow < batch->numElements*/
-            printer->printRow(curRow, tuple, 0);
-            curRow++;
+        len = clipLen;
+        charLen = maxLen;
+    }
 
-            return true;
+    if (!blankPad || charLen == maxLen)
+        return makeVarlena(arena, data, len);
+
+    int64_t padLen = maxLen - charLen;
+    struct varlena *result = (struct varlena *) arena.alloc(len + padLen + VARHDRSZ);
+
+    SET_VARSIZE(result, len + padLen + VARHDRSZ);
+    memcpy(VARDATA(result), data, len);
+    memset(VARDATA(result) + len, ' ', padLen);
+
+    return PointerGetDatum(result);
+}
+
+/* by-value float Datums without the out-of-line Float[48]GetDatum() calls */
+static inline Datum float8Datum(double value) {
+#ifdef USE_FLOAT8_BYVAL
+    int64 bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    return (Datum) bits;
+#else
+    return Float8GetDatum(value);
+#endif
+}
+
+static inline Datum float4Datum(double value) {
+#if defined(USE_FLOAT4_BYVAL) || PG_VERSION_NUM >= 130000
+    float4 narrowed = (float4) value;
+    int32 bits;
+
+    memcpy(&bits, &narrowed, sizeof(bits));
+    return Int32GetDatum(bits);
+#else
+    return Float4GetDatum((float4) value);
+#endif
+}
+
+static inline void convertNulls(const orc::ColumnVectorBatch *vector, const uint32_t *rows, uint64_t rowCount,
+                                bool *nulls) {
+    if (!vector->hasNulls) {
+        memset(nulls, false, rowCount * sizeof(bool));
+        return;
+    }
+
+    const char *notNull = vector->notNull.data();
+    for (uint64_t row = 0; row < rowCount; row++)
+        nulls[row] = !notNull[rows[row]];
+}
+
+/*
+ * Value conversions of the fixed width kernels. Each has toDatum() and
+ * outOfRange(), the range check is accumulated over the whole batch so the
+ * loop has no branch.
+ */
+template <typename T>
+struct NoRangeCheck {
+    static bool outOfRange(T) { return false; }
+    static const char *rangeError() { return ""; }
+};
+
+struct LongToBool : NoRangeCheck<int64_t> {
+    static Datum toDatum(int64_t value) { return BoolGetDatum(value != 0); }
+};
+
+struct LongToInt2 {
+    static Datum toDatum(int64_t value) { return Int16GetDatum((int16) value); }
+    static bool outOfRange(int64_t value) { return (value < INT16_MIN) | (value > INT16_MAX); }
+    static const char *rangeError() { return "smallint out of range"; }
+};
+
+struct LongToInt4 {
+    static Datum toDatum(int64_t value) { return Int32GetDatum((int32) value); }
+    static bool outOfRange(int64_t value) { return (value < INT32_MIN) | (value > INT32_MAX); }
+    static const char *rangeError() { return "integer out of range"; }
+};
+
+struct LongToInt8 : NoRangeCheck<int64_t> {
+    static Datum toDatum(int64_t value) { return Int64GetDatum(value); }
+};
+
+/* orc dates are days since 1970-01-01, postgres dates days since 2000-01-01 */
+struct LongToDate : NoRangeCheck<int64_t> {
+    static Datum toDatum(int64_t value) {
+        return DateADTGetDatum((DateADT) (value - (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE)));
+    }
+};
+
+struct DoubleToFloat4 : NoRangeCheck<double> {
+    static Datum toDatum(double value) { return float4Datum(value); }
+};
+
+struct DoubleToFloat8 : NoRangeCheck<double> {
+    static Datum toDatum(double value) { return float8Datum(value); }
+};
+
+template <class VectorType, class Convert>
+static void convertFixedColumn(ColumnConverter &converter, const uint32_t *rows, uint64_t rowCount,
+                               Datum *values, bool *nulls) {
+    const VectorType *vector = static_cast<const VectorType *>(converter.vector);
+    const auto *data = vector->data.data();
+    bool outOfRange = false;
+
+    convertNulls(vector, rows, rowCount, nulls);
+
+    /* values of null rows are converted too, their Datums are never looked at */
+    for (uint64_t row = 0; row < rowCount; row++) {
+        values[row] = Convert::toDatum(data[rows[row]]);
+        outOfRange |= Convert::outOfRange(data[rows[row]]) & !nulls[row];
+    }
+
+    if (outOfRange)
+        throw std::range_error(Convert::rangeError());
+}
+
+/* text, bytea, varchar(n) and char(n) from a StringVectorBatch */
+template <bool limited, bool blankPad>
+static void convertStringColumn(ColumnConverter &converter, const uint32_t *rows, uint64_t rowCount,
+                               Datum *values, bool *nulls) {
+    const orc::StringVectorBatch *vector = static_cast<const orc::StringVectorBatch *>(converter.vector);
+    char * const *data = vector->data.data();
+    const int64_t *length = vector->length.data();
+
+    BatchArena &arena = *converter.arena;
+    uint64_t totalSize = 0;
+
+    convertNulls(vector, rows, rowCount, nulls);
+
+    /* one chunk for the whole column, padding of char(n) may take another */
+    for (uint64_t row = 0; row < rowCount; row++)
+        totalSize += nulls[row] ? 0 : MAXALIGN(length[rows[row]] + VARHDRSZ);
+    arena.reserve(totalSize);
+
+    for (uint64_t row = 0; row < rowCount; row++) {
+        if (nulls[row])
+            values[row] = (Datum) 0;
+        else if (limited)
+            values[row] = makeLimitedVarlena(arena, data[rows[row]], length[rows[row]], converter.typeMod, blankPad);
+        else
+            values[row] = makeVarlena(arena, data[rows[row]], length[rows[row]]);
+    }
+}
+
+#if defined(HAVE_INT64_TIMESTAMP) || PG_VERSION_NUM >= 100000
+/* orc timestamps are seconds + nanoseconds of the UTC wall clock, same as the printed text */
+static void convertTimestampColumn(ColumnConverter &converter, const uint32_t *rows, uint64_t rowCount,
+                               Datum *values, bool *nulls) {
+    const orc::TimestampVectorBatch *vector = static_cast<const orc::TimestampVectorBatch *>(converter.vector);
+    const int64_t *seconds = vector->data.data();
+    const int64_t *nanoseconds = vector->nanoseconds.data();
+    const int64_t epochOffset = (int64_t) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY;
+
+    convertNulls(vector, rows, rowCount, nulls);
+
+    for (uint64_t row = 0; row < rowCount; row++)
+        values[row] = TimestampGetDatum((seconds[rows[row]] - epochOffset) * USECS_PER_SEC
+                                        + nanoseconds[rows[row]] / 1000);
+}
+#endif
+
+/* dropped columns and columns missing from the file */
+static void convertNullColumn(ColumnConverter &converter, const uint32_t *rows, uint64_t rowCount,
+                               Datum *values, bool *nulls) {
+    memset(values, 0, rowCount * sizeof(Datum));
+    memset(nulls, true, rowCount * sizeof(bool));
+}
+
+/* unmapped types: cstrings in the arena, to be parsed by the type's input function */
+static void convertTextColumn(ColumnConverter &converter, const uint32_t *rows, uint64_t rowCount,
+                               Datum *values, bool *nulls) {
+    convertNulls(converter.vector, rows, rowCount, nulls);
+
+    for (uint64_t row = 0; row < rowCount; row++) {
+        char *text = NULL;
+
+        values[row] = (Datum) 0;
+        if (nulls[row])
+            continue;
+
+        /* my modified printRow(int rowId, char** tuple, int curColId), result is malloc'd */
+        converter.printer->printRow(rows[row], &text, 0);
+        if (text == NULL) {
+            nulls[row] = true;
+            continue;
         }
+
+        size_t len = strlen(text);
+        char *copy = converter.arena->alloc(len + 1);
+
+        memcpy(copy, text, len + 1);
+        free(text);
+        values[row] = PointerGetDatum(copy);
+    }
+}
+
+struct ConverterEntry {
+    orc::TypeKind kind;
+    Oid typeId;
+    ColumnKernel kernel;
+};
+
+#define INTEGER_KERNELS(kind) \
+    { kind, INT2OID, convertFixedColumn<orc::LongVectorBatch, LongToInt2> }, \
+    { kind, INT4OID, convertFixedColumn<orc::LongVectorBatch, LongToInt4> }, \
+    { kind, INT8OID, convertFixedColumn<orc::LongVectorBatch, LongToInt8> }
+
+#define FLOAT_KERNELS(kind) \
+    { kind, FLOAT4OID, convertFixedColumn<orc::DoubleVectorBatch, DoubleToFloat4> }, \
+    { kind, FLOAT8OID, convertFixedColumn<orc::DoubleVectorBatch, DoubleToFloat8> }
+
+#define STRING_KERNELS(kind) \
+    { kind, TEXTOID, convertStringColumn<false, false> }, \
+    { kind, VARCHAROID, convertStringColumn<true, false> }, \
+    { kind, BPCHAROID, convertStringColumn<true, true> }
+
+/* binary kernels by (orc TypeKind, atttypid) */
+static const ConverterEntry converterTable[] = {
+    { orc::BOOLEAN, BOOLOID, convertFixedColumn<orc::LongVectorBatch, LongToBool> },
+    INTEGER_KERNELS(orc::BOOLEAN),
+    INTEGER_KERNELS(orc::BYTE),
+    INTEGER_KERNELS(orc::SHORT),
+    INTEGER_KERNELS(orc::INT),
+    INTEGER_KERNELS(orc::LONG),
+    FLOAT_KERNELS(orc::FLOAT),
+    FLOAT_KERNELS(orc::DOUBLE),
+    STRING_KERNELS(orc::STRING),
+    STRING_KERNELS(orc::VARCHAR),
+    STRING_KERNELS(orc::CHAR),
+    { orc::BINARY, BYTEAOID, convertStringColumn<false, false> },
+    { orc::DATE, DATEOID, convertFixedColumn<orc::LongVectorBatch, LongToDate> },
+#if defined(HAVE_INT64_TIMESTAMP) || PG_VERSION_NUM >= 100000
+    { orc::TIMESTAMP, TIMESTAMPOID, convertTimestampColumn },
+#endif
+};
+
+static ColumnKernel resolveKernel(orc::TypeKind kind, Oid typeId) {
+    for (size_t i = 0; i < sizeof(converterTable) / sizeof(converterTable[0]); i++) {
+        if (converterTable[i].kind == kind && converterTable[i].typeId == typeId)
+            return converterTable[i].kernel;
     }
 
-    /**
-    * Get the number of rows in the file.
-    * @return the number of rows
-    */
-    unsigned long long OrcGetTupleCount(const char* filename) {
-        return reader->getNumberOfRows();
+    return convertTextColumn;
+}
+
+/* a copy of the OrcPredicate tree, owned by the reader */
+struct SearchArgument {
+    OrcPredicateOp op;
+    unsigned int column;
+    OrcValueKind kind;
+    int64_t intValue;
+    double doubleValue;
+    std::string stringValue;
+    std::vector<SearchArgument> children;
+
+    SearchArgument(const OrcPredicate &predicate)
+        : op(predicate.op), column(predicate.column), kind(predicate.kind),
+          intValue(predicate.intValue), doubleValue(predicate.doubleValue) {
+        if (predicate.kind == ORC_VALUE_STRING && predicate.stringValue != NULL)
+            stringValue.assign(predicate.stringValue, predicate.stringLength);
+
+        for (unsigned int i = 0; i < predicate.childCount; i++)
+            children.push_back(SearchArgument(predicate.children[i]));
     }
 };
 
-std::unordered_map<const char*, OrcReader*> readerMap;//<filename, OrcReader>
+/*
+ * Moves a postgres timestamp to orc's 1970 epoch, in microseconds. false when
+ * that overflows, as it does for 'infinity'.
+ */
+static bool unixMicrosOf(int64_t timestamp, int64_t *micros) {
+    const int64_t epochOffset = (int64_t) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY * 1000000;
+
+    if (timestamp > INT64_MAX - epochOffset)
+        return false;
+    *micros = timestamp + epochOffset;
+    return true;
+}
+
+/* can a value in [min, max] satisfy "value op constant"? */
+template <typename T>
+static bool rangeMayMatch(OrcPredicateOp op, const T &min, const T &max, const T &constant) {
+    switch (op) {
+        case ORC_PREDICATE_EQ:
+            return !(constant < min) && !(max < constant);
+        case ORC_PREDICATE_LT:
+            return min < constant;
+        case ORC_PREDICATE_LE:
+            return !(constant < min);
+        case ORC_PREDICATE_GT:
+            return constant < max;
+        case ORC_PREDICATE_GE:
+            return !(max < constant);
+        default:
+            return true;
+    }
+}
+
+/*
+ * Can a row with the given column statistics satisfy the comparison? Anything
+ * the statistics can't answer, e.g. missing min/max or a column type that
+ * doesn't match the constant, may match.
+ */
+static bool statisticsMayMatch(const SearchArgument &argument, const orc::ColumnStatistics *statistics) {
+    if (statistics == NULL)
+        return true;
 
+    switch (argument.kind) {
+        case ORC_VALUE_INT: {
+            const orc::IntegerColumnStatistics *stats =
+                dynamic_cast<const orc::IntegerColumnStatistics *>(statistics);
 
-// wrapper functions:
+            if (stats == NULL || !stats->hasMinimum() || !stats->hasMaximum())
+                return true;
+            return rangeMayMatch<int64_t>(argument.op, stats->getMinimum(), stats->getMaximum(),
+                                          argument.intValue);
+        }
+        case ORC_VALUE_DOUBLE: {
+            const orc::DoubleColumnStatistics *stats =
+                dynamic_cast<const orc::DoubleColumnStatistics *>(statistics);
+
+            /* NaN sorts above everything in postgres but breaks min/max */
+            if (stats == NULL || !stats->hasMinimum() || !stats->hasMaximum()
+                || std::isnan(stats->getMinimum()) || std::isnan(stats->getMaximum())
+                || std::isnan(argument.doubleValue))
+                return true;
+            return rangeMayMatch<double>(argument.op, stats->getMinimum(), stats->getMaximum(),
+                                         argument.doubleValue);
+        }
+        case ORC_VALUE_STRING: {
+            const orc::StringColumnStatistics *stats =
+                dynamic_cast<const orc::StringColumnStatistics *>(statistics);
+
+            /* byte-wise, the planner only pushes down range operators of C collation */
+            if (stats == NULL || !stats->hasMinimum() || !stats->hasMaximum())
+                return true;
+            return rangeMayMatch<std::string>(argument.op, stats->getMinimum(), stats->getMaximum(),
+                                              argument.stringValue);
+        }
+        case ORC_VALUE_DATE: {
+            const orc::DateColumnStatistics *stats =
+                dynamic_cast<const orc::DateColumnStatistics *>(statistics);
 
-/* init global var, should be used in BeginForeignScan() */
-void initOrcReader(const char* filename, unsigned int fdwColNum, unsigned int fdwMaxRowPerBatch) {
-    if(readerMap.find(filename) != readerMap.end()) {// already existed
-        free(readerMap[filename]);
-        readerMap[filename] = NULL;
-        readerMap.erase(filename);
+            if (stats == NULL || !stats->hasMinimum() || !stats->hasMaximum())
+                return true;
+            /* orc dates are days since 1970-01-01 */
+            return rangeMayMatch<int64_t>(argument.op, stats->getMinimum(), stats->getMaximum(),
+                                          argument.intValue + (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE));
+        }
+        case ORC_VALUE_TIMESTAMP: {
+            const orc::TimestampColumnStatistics *stats =
+                dynamic_cast<const orc::TimestampColumnStatistics *>(statistics);
+
+            if (stats == NULL || !stats->hasMinimum() || !stats->hasMaximum())
+                return true;
+            int64_t constant;
+            if (!unixMicrosOf(argument.intValue, &constant))
+                return true;
+            /* orc keeps milliseconds since 1970-01-01, widen them to cover the truncated micros */
+            return rangeMayMatch<int64_t>(argument.op, stats->getMinimum() * 1000,
+                                          stats->getMaximum() * 1000 + 999, constant);
+        }
     }
 
-    OrcReader * orcreader = new OrcReader(filename, fdwColNum, fdwMaxRowPerBatch);
-    readerMap[filename] = orcreader;
+    return true;
 }
 
-/* release tuple memory, should be used in EndForeignScan() */
-void releaseOrcReader(const char* filename) {
-    if(readerMap.find(filename) != readerMap.end()) {// already existed
-        free(readerMap[filename]);
-        readerMap[filename] = NULL;
-        readerMap.erase(filename);
+/*
+ * Range of a column with numeric statistics, as doubles in the column's own
+ * units. false for other statistics, missing min/max or NaN.
+ */
+static bool numericRange(const orc::ColumnStatistics *statistics, double *minimum, double *maximum) {
+    const orc::IntegerColumnStatistics *integerStats = dynamic_cast<const orc::IntegerColumnStatistics *>(statistics);
+    const orc::DoubleColumnStatistics *doubleStats = dynamic_cast<const orc::DoubleColumnStatistics *>(statistics);
+    const orc::DateColumnStatistics *dateStats = dynamic_cast<const orc::DateColumnStatistics *>(statistics);
+    const orc::TimestampColumnStatistics *timestampStats =
+        dynamic_cast<const orc::TimestampColumnStatistics *>(statistics);
+
+    if (integerStats != NULL && integerStats->hasMinimum() && integerStats->hasMaximum()) {
+        *minimum = (double) integerStats->getMinimum();
+        *maximum = (double) integerStats->getMaximum();
+    }
+    else if (doubleStats != NULL && doubleStats->hasMinimum() && doubleStats->hasMaximum()) {
+        *minimum = doubleStats->getMinimum();
+        *maximum = doubleStats->getMaximum();
+    }
+    else if (dateStats != NULL && dateStats->hasMinimum() && dateStats->hasMaximum()) {
+        *minimum = dateStats->getMinimum();
+        *maximum = dateStats->getMaximum();
+    }
+    else if (timestampStats != NULL && timestampStats->hasMinimum() && timestampStats->hasMaximum()) {
+        *minimum = (double) timestampStats->getMinimum();
+        *maximum = (double) timestampStats->getMaximum();
     }
+    else
+        return false;
+
+    return !std::isnan(*minimum) && !std::isnan(*maximum);
 }
 
-/**
- * iteratively get one line record, should be used in IterativeForeignScan()
- * @return: false means no next record.
+/* first index of [begin, end) for which pred is false, pred holds for a prefix */
+template <typename Predicate>
+static uint64_t partitionPoint(uint64_t begin, uint64_t end, Predicate pred) {
+    while (begin < end) {
+        uint64_t middle = begin + (end - begin) / 2;
+
+        if (pred(middle))
+            begin = middle + 1;
+        else
+            end = middle;
+    }
+    return begin;
+}
+
+/* fieldColumnIds maps fdw columns to orc column ids, -1 if not in the file */
+static bool searchArgumentMayMatch(const SearchArgument &argument, const orc::Statistics &statistics,
+                                   const std::vector<int64_t> &fieldColumnIds) {
+    switch (argument.op) {
+        case ORC_PREDICATE_AND:
+            for (size_t i = 0; i < argument.children.size(); i++) {
+                if (!searchArgumentMayMatch(argument.children[i], statistics, fieldColumnIds))
+                    return false;
+            }
+            return true;
+        case ORC_PREDICATE_OR:
+            for (size_t i = 0; i < argument.children.size(); i++) {
+                if (searchArgumentMayMatch(argument.children[i], statistics, fieldColumnIds))
+                    return true;
+            }
+            return argument.children.empty();
+        default: {
+            if (argument.column >= fieldColumnIds.size() || fieldColumnIds[argument.column] < 0)
+                return true;
+
+            uint32_t columnId = (uint32_t) fieldColumnIds[argument.column];
+            if (columnId >= statistics.getNumberOfColumns())
+                return true;
+
+            return statisticsMayMatch(argument, statistics.getColumnStatistics(columnId));
+        }
+    }
+}
+
+/* does "value op constant" hold, given cmp = sign of (value - constant)? */
+static bool comparisonHolds(OrcPredicateOp op, int cmp) {
+    switch (op) {
+        case ORC_PREDICATE_EQ:
+            return cmp == 0;
+        case ORC_PREDICATE_LT:
+            return cmp < 0;
+        case ORC_PREDICATE_LE:
+            return cmp <= 0;
+        case ORC_PREDICATE_GT:
+            return cmp > 0;
+        case ORC_PREDICATE_GE:
+            return cmp >= 0;
+        default:
+            return true;
+    }
+}
+
+template <typename T>
+static int compareValues(const T &value, const T &constant) {
+    return (value < constant) ? -1 : (constant < value) ? 1 : 0;
+}
+
+/* float8 ordering of postgres, NaN equals itself and sorts above everything */
+static int compareDoubles(double value, double constant) {
+    if (std::isnan(value))
+        return std::isnan(constant) ? 0 : 1;
+    if (std::isnan(constant))
+        return -1;
+    return compareValues(value, constant);
+}
+
+/*
+ * Can the row satisfy the search argument? fields and kinds map fdw columns
+ * to the vectors holding them and their orc types, comparisons on columns
+ * without a vector or with a type the constant doesn't fit may match.
  */
-bool getOrcNextTuple(const char* filename, char **tuple) {
-    if(readerMap.find(filename) == readerMap.end()) {
-        // haven't initialized
+static bool rowMayMatch(const SearchArgument &argument, const std::vector<const orc::ColumnVectorBatch *> &fields,
+                        const std::vector<orc::TypeKind> &kinds, uint64_t row) {
+    switch (argument.op) {
+        case ORC_PREDICATE_AND:
+            for (size_t i = 0; i < argument.children.size(); i++) {
+                if (!rowMayMatch(argument.children[i], fields, kinds, row))
+                    return false;
+            }
+            return true;
+        case ORC_PREDICATE_OR:
+            for (size_t i = 0; i < argument.children.size(); i++) {
+                if (rowMayMatch(argument.children[i], fields, kinds, row))
+                    return true;
+            }
+            return argument.children.empty();
+        default:
+            break;
+    }
+
+    if (argument.column >= fields.size() || fields[argument.column] == NULL)
+        return true;
+
+    const orc::ColumnVectorBatch *vector = fields[argument.column];
+    orc::TypeKind kind = kinds[argument.column];
+
+    /* a comparison with null is never true */
+    if (vector->hasNulls && !vector->notNull.data()[row])
         return false;
+
+    switch (argument.kind) {
+        case ORC_VALUE_INT:
+            if (kind != orc::BYTE && kind != orc::SHORT && kind != orc::INT && kind != orc::LONG)
+                return true;
+            return comparisonHolds(argument.op, compareValues<int64_t>(
+                static_cast<const orc::LongVectorBatch *>(vector)->data.data()[row], argument.intValue));
+        case ORC_VALUE_DOUBLE:
+            if (kind != orc::FLOAT && kind != orc::DOUBLE)
+                return true;
+            return comparisonHolds(argument.op, compareDoubles(
+                static_cast<const orc::DoubleVectorBatch *>(vector)->data.data()[row], argument.doubleValue));
+        case ORC_VALUE_STRING: {
+            if (kind != orc::STRING && kind != orc::VARCHAR && kind != orc::CHAR)
+                return true;
+
+            const orc::StringVectorBatch *strings = static_cast<const orc::StringVectorBatch *>(vector);
+            size_t length = (size_t) strings->length.data()[row];
+            size_t common = std::min(length, argument.stringValue.size());
+            int cmp = memcmp(strings->data.data()[row], argument.stringValue.data(), common);
+
+            if (cmp == 0)
+                cmp = compareValues(length, argument.stringValue.size());
+            return comparisonHolds(argument.op, cmp);
+        }
+        case ORC_VALUE_DATE:
+            if (kind != orc::DATE)
+                return true;
+            /* orc dates are days since 1970-01-01 */
+            return comparisonHolds(argument.op, compareValues<int64_t>(
+                static_cast<const orc::LongVectorBatch *>(vector)->data.data()[row]
+                    - (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE),
+                argument.intValue));
+        case ORC_VALUE_TIMESTAMP: {
+            if (kind != orc::TIMESTAMP)
+                return true;
+
+            /* the same conversion as convertTimestampColumn */
+            const orc::TimestampVectorBatch *timestamps = static_cast<const orc::TimestampVectorBatch *>(vector);
+            const int64_t epochOffset = (int64_t) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY;
+            int64_t value = (timestamps->data.data()[row] - epochOffset) * USECS_PER_SEC
+                            + timestamps->nanoseconds.data()[row] / 1000;
+
+            return comparisonHolds(argument.op, compareValues<int64_t>(value, argument.intValue));
+        }
     }
 
-    OrcReader* orcreader = readerMap[filename];
-    return orcreader->OrcGetNext(tuple);
+    return true;
 }
 
-/**
- * Get the number of rows in the file.
- * @return the number of rows
+static void searchArgumentColumns(const SearchArgument &argument, std::set<unsigned int> &columns) {
+    if (argument.op == ORC_PREDICATE_AND || argument.op == ORC_PREDICATE_OR) {
+        for (size_t i = 0; i < argument.children.size(); i++)
+            searchArgumentColumns(argument.children[i], columns);
+    }
+    else
+        columns.insert(argument.column);
+}
+
+/*
+ * Filter kernels. They AND "data[row] op constant" into match[row], one byte
+ * per row, so comparisons on several columns combine without branches. The
+ * comparisons follow postgres' float ordering as long as the constant isn't
+ * NaN: NaN data is above every constant, so only > and >= hold for it.
  */
-unsigned long long getOrcTupleCount(const char* filename) {
-    if(readerMap.find(filename) == readerMap.end()) {
-        // haven't initialized
-        return 0;
+typedef void (*FilterKernel)(const void *data, uint64_t rowCount, const void *constant, uint8_t *match);
+
+template <typename T, OrcPredicateOp op>
+static inline bool valueSatisfies(T value, T constant) {
+    switch (op) {
+        case ORC_PREDICATE_EQ:
+            return value == constant;
+        case ORC_PREDICATE_LT:
+            return value < constant;
+        case ORC_PREDICATE_LE:
+            return value <= constant;
+        case ORC_PREDICATE_GT:
+            return !(value <= constant);
+        case ORC_PREDICATE_GE:
+            return !(value < constant);
+        default:
+            return true;
+    }
+}
+
+template <typename T, OrcPredicateOp op>
+static void filterScalar(const void *data, uint64_t rowCount, const void *constant, uint8_t *match) {
+    const T *values = static_cast<const T *>(data);
+    const T value = *static_cast<const T *>(constant);
+
+    for (uint64_t row = 0; row < rowCount; row++)
+        match[row] &= valueSatisfies<T, op>(values[row], value);
+}
+
+/* NaN constants are rare, they get the generic comparison */
+template <OrcPredicateOp op>
+static void filterNaN(const void *data, uint64_t rowCount, const void *constant, uint8_t *match) {
+    const double *values = static_cast<const double *>(data);
+    const double value = *static_cast<const double *>(constant);
+
+    for (uint64_t row = 0; row < rowCount; row++)
+        match[row] &= comparisonHolds(op, compareDoubles(values[row], value));
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define ORC_AVX2_FILTERS
+
+/* 4-bit lane mask of a 256-bit comparison, widened to 4 match bytes */
+static const uint32_t laneMaskBytes[16] = {
+    0x00000000, 0x00000001, 0x00000100, 0x00000101,
+    0x00010000, 0x00010001, 0x00010100, 0x00010101,
+    0x01000000, 0x01000001, 0x01000100, 0x01000101,
+    0x01010000, 0x01010001, 0x01010100, 0x01010101
+};
+
+__attribute__((target("avx2")))
+static inline void andLaneMask(int mask, uint8_t *match) {
+    uint32_t bytes;
+
+    memcpy(&bytes, match, sizeof(bytes));
+    bytes &= laneMaskBytes[mask];
+    memcpy(match, &bytes, sizeof(bytes));
+}
+
+template <OrcPredicateOp op>
+__attribute__((target("avx2")))
+static void filterLongAvx2(const void *data, uint64_t rowCount, const void *constant, uint8_t *match) {
+    const int64_t *values = static_cast<const int64_t *>(data);
+    const __m256i constants = _mm256_set1_epi64x(*static_cast<const int64_t *>(constant));
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    uint64_t row = 0;
+
+    for (; row + 4 <= rowCount; row += 4) {
+        __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + row));
+        __m256i result;
+
+        switch (op) {
+            case ORC_PREDICATE_EQ:
+                result = _mm256_cmpeq_epi64(lanes, constants);
+                break;
+            case ORC_PREDICATE_LT:
+                result = _mm256_cmpgt_epi64(constants, lanes);
+                break;
+            case ORC_PREDICATE_LE:
+                result = _mm256_xor_si256(_mm256_cmpgt_epi64(lanes, constants), ones);
+                break;
+            case ORC_PREDICATE_GT:
+                result = _mm256_cmpgt_epi64(lanes, constants);
+                break;
+            default:
+                result = _mm256_xor_si256(_mm256_cmpgt_epi64(constants, lanes), ones);
+                break;
+        }
+        andLaneMask(_mm256_movemask_pd(_mm256_castsi256_pd(result)), match + row);
+    }
+
+    filterScalar<int64_t, op>(values + row, rowCount - row, constant, match + row);
+}
+
+template <OrcPredicateOp op>
+__attribute__((target("avx2")))
+static void filterDoubleAvx2(const void *data, uint64_t rowCount, const void *constant, uint8_t *match) {
+    const double *values = static_cast<const double *>(data);
+    const __m256d constants = _mm256_set1_pd(*static_cast<const double *>(constant));
+    uint64_t row = 0;
+
+    for (; row + 4 <= rowCount; row += 4) {
+        __m256d lanes = _mm256_loadu_pd(values + row);
+        __m256d result;
+
+        /* ordered comparisons are false for NaN, the negated unordered ones true */
+        switch (op) {
+            case ORC_PREDICATE_EQ:
+                result = _mm256_cmp_pd(lanes, constants, _CMP_EQ_OQ);
+                break;
+            case ORC_PREDICATE_LT:
+                result = _mm256_cmp_pd(lanes, constants, _CMP_LT_OQ);
+                break;
+            case ORC_PREDICATE_LE:
+                result = _mm256_cmp_pd(lanes, constants, _CMP_LE_OQ);
+                break;
+            case ORC_PREDICATE_GT:
+                result = _mm256_cmp_pd(lanes, constants, _CMP_NLE_UQ);
+                break;
+            default:
+                result = _mm256_cmp_pd(lanes, constants, _CMP_NLT_UQ);
+                break;
+        }
+        andLaneMask(_mm256_movemask_pd(result), match + row);
     }
 
-    OrcReader* orcreader = readerMap[filename];
-    return orcreader->OrcGetTupleCount(filename);
+    filterScalar<double, op>(values + row, rowCount - row, constant, match + row);
+}
+
+static bool cpuHasAvx2() {
+    static const bool hasAvx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+
+    return hasAvx2;
+}
+#endif
+
+#define FILTER_KERNELS(kernel) { kernel<ORC_PREDICATE_EQ>, kernel<ORC_PREDICATE_LT>, \
+    kernel<ORC_PREDICATE_LE>, kernel<ORC_PREDICATE_GT>, kernel<ORC_PREDICATE_GE> }
+
+template <OrcPredicateOp op>
+static void filterLongScalar(const void *data, uint64_t rowCount, const void *constant, uint8_t *match) {
+    filterScalar<int64_t, op>(data, rowCount, constant, match);
+}
+
+template <OrcPredicateOp op>
+static void filterDoubleScalar(const void *data, uint64_t rowCount, const void *constant, uint8_t *match) {
+    filterScalar<double, op>(data, rowCount, constant, match);
+}
+
+/* pick the kernel for the comparison, AVX2 when the cpu running the backend has it */
+static FilterKernel resolveFilterKernel(bool isDouble, bool constantIsNaN, OrcPredicateOp op) {
+    static const FilterKernel longScalar[] = FILTER_KERNELS(filterLongScalar);
+    static const FilterKernel doubleScalar[] = FILTER_KERNELS(filterDoubleScalar);
+    static const FilterKernel doubleNaN[] = FILTER_KERNELS(filterNaN);
+#ifdef ORC_AVX2_FILTERS
+    static const FilterKernel longAvx2[] = FILTER_KERNELS(filterLongAvx2);
+    static const FilterKernel doubleAvx2[] = FILTER_KERNELS(filterDoubleAvx2);
+#endif
+
+    if (isDouble && constantIsNaN)
+        return doubleNaN[op];
+#ifdef ORC_AVX2_FILTERS
+    if (cpuHasAvx2())
+        return isDouble ? doubleAvx2[op] : longAvx2[op];
+#endif
+    return isDouble ? doubleScalar[op] : longScalar[op];
+}
+
+/* a comparison the reader evaluates on the raw vectors of each batch */
+struct BatchFilter {
+    FilterKernel kernel;
+    const orc::ColumnVectorBatch *vector;
+    bool isDouble;          /* DoubleVectorBatch, else LongVectorBatch */
+    int64_t longConstant;   /* in the vector's units */
+    double doubleConstant;
+};
+
+/*
+ * Decoded values of one included field over a whole stripe, the unit of the
+ * shared chunk cache. Serialized as a ChunkHeader, the notNull flags padded to
+ * 8 bytes, one 8 byte value per row (long, double or timestamp seconds), then
+ * per row the nanoseconds of a timestamp or the length of a string, and last
+ * the string bytes.
+ */
+enum ChunkKind { CHUNK_LONG, CHUNK_DOUBLE, CHUNK_STRING, CHUNK_TIMESTAMP };
+
+struct ChunkHeader {
+    uint64_t rowCount;
+    uint32_t kind;
+    uint32_t hasNulls;
+};
+
+struct StripeChunk {
+    ChunkKind kind;
+    orc::ColumnVectorBatch *vector;     /* the field in the row batch */
+    uint32_t column;                    /* orc column id, part of the cache key */
+
+    /* rows of the stripe read from the file so far */
+    std::vector<char> notNull;
+    std::vector<int64_t> values;
+    std::vector<int64_t> extra;
+    std::vector<char> bytes;
+    bool hasNulls;
+
+    /* the stripe's chunk as found in the cache, loaded is never shrunk */
+    std::vector<char> loaded;
+    ChunkHeader header;
+    const int64_t *loadedValues;
+    const int64_t *loadedExtra;
+    std::vector<char *> strings;        /* start of each loaded string */
+};
+
+/* flat vectors of primitive types are cached, a file with any other included field isn't */
+static bool chunkKindOf(const orc::ColumnVectorBatch *vector, ChunkKind *kind) {
+    if (dynamic_cast<const orc::LongVectorBatch *>(vector) != NULL)
+        *kind = CHUNK_LONG;
+    else if (dynamic_cast<const orc::DoubleVectorBatch *>(vector) != NULL)
+        *kind = CHUNK_DOUBLE;
+    else if (dynamic_cast<const orc::StringVectorBatch *>(vector) != NULL)
+        *kind = CHUNK_STRING;
+    else if (dynamic_cast<const orc::TimestampVectorBatch *>(vector) != NULL)
+        *kind = CHUNK_TIMESTAMP;
+    else
+        return false;
+    return true;
+}
+
+static size_t chunkValuesOffset(uint64_t rowCount) {
+    return sizeof(ChunkHeader) + ((rowCount + 7) & ~((uint64_t) 7));
+}
+
+/* serialized length of the rows collected so far */
+static size_t chunkLength(const StripeChunk &chunk) {
+    return chunkValuesOffset(chunk.notNull.size()) + (chunk.values.size() + chunk.extra.size()) * sizeof(int64_t)
+           + chunk.bytes.size();
+}
+
+/* append the first rowCount rows of the field's vector to the chunk */
+static void appendChunkRows(StripeChunk &chunk, uint64_t rowCount) {
+    const char *notNull = chunk.vector->notNull.data();
+    size_t first = chunk.values.size();
+
+    if (chunk.vector->hasNulls) {
+        chunk.notNull.insert(chunk.notNull.end(), notNull, notNull + rowCount);
+        chunk.hasNulls = true;
+    }
+    else
+        chunk.notNull.insert(chunk.notNull.end(), rowCount, 1);
+
+    chunk.values.resize(first + rowCount);
+
+    switch (chunk.kind) {
+        case CHUNK_LONG:
+            memcpy(&chunk.values[first], static_cast<orc::LongVectorBatch *>(chunk.vector)->data.data(),
+                   rowCount * sizeof(int64_t));
+            break;
+        case CHUNK_DOUBLE:
+            memcpy(&chunk.values[first], static_cast<orc::DoubleVectorBatch *>(chunk.vector)->data.data(),
+                   rowCount * sizeof(double));
+            break;
+        case CHUNK_TIMESTAMP: {
+            orc::TimestampVectorBatch *vector = static_cast<orc::TimestampVectorBatch *>(chunk.vector);
+
+            memcpy(&chunk.values[first], vector->data.data(), rowCount * sizeof(int64_t));
+            chunk.extra.insert(chunk.extra.end(), vector->nanoseconds.data(),
+                               vector->nanoseconds.data() + rowCount);
+            break;
+        }
+        case CHUNK_STRING: {
+            orc::StringVectorBatch *vector = static_cast<orc::StringVectorBatch *>(chunk.vector);
+
+            /* values are unused for strings, the lengths go to extra */
+            chunk.values.resize(first);
+            for (uint64_t row = 0; row < rowCount; row++) {
+                int64_t length = (notNull[row] || !chunk.vector->hasNulls) ? vector->length.data()[row] : 0;
+
+                chunk.extra.push_back(length);
+                chunk.bytes.insert(chunk.bytes.end(), vector->data.data()[row], vector->data.data()[row] + length);
+            }
+            break;
+        }
+    }
+}
+
+static void serializeChunk(const StripeChunk &chunk, std::vector<char> &out) {
+    ChunkHeader header;
+    uint64_t rowCount = chunk.notNull.size();
+    size_t offset = chunkValuesOffset(rowCount);
+
+    header.rowCount = rowCount;
+    header.kind = chunk.kind;
+    header.hasNulls = chunk.hasNulls;
+
+    out.assign(chunkLength(chunk), 0);
+    memcpy(out.data(), &header, sizeof(header));
+    memcpy(out.data() + sizeof(header), chunk.notNull.data(), rowCount);
+    memcpy(out.data() + offset, chunk.values.data(), chunk.values.size() * sizeof(int64_t));
+    offset += chunk.values.size() * sizeof(int64_t);
+    memcpy(out.data() + offset, chunk.extra.data(), chunk.extra.size() * sizeof(int64_t));
+    offset += chunk.extra.size() * sizeof(int64_t);
+    memcpy(out.data() + offset, chunk.bytes.data(), chunk.bytes.size());
+}
+
+/* point the loaded* members into a chunk of length bytes, false if it doesn't fit rowCount rows */
+static bool attachChunk(StripeChunk &chunk, size_t length, uint64_t rowCount) {
+    const char *data = chunk.loaded.data();
+    size_t offset = chunkValuesOffset(rowCount);
+    size_t extraCount = (chunk.kind == CHUNK_STRING || chunk.kind == CHUNK_TIMESTAMP) ? rowCount : 0;
+    size_t valueCount = (chunk.kind == CHUNK_STRING) ? 0 : rowCount;
+
+    if (length < offset + (valueCount + extraCount) * sizeof(int64_t))
+        return false;
+
+    memcpy(&chunk.header, data, sizeof(ChunkHeader));
+    if (chunk.header.rowCount != rowCount || chunk.header.kind != (uint32_t) chunk.kind)
+        return false;
+
+    chunk.loadedValues = reinterpret_cast<const int64_t *>(data + offset);
+    chunk.loadedExtra = chunk.loadedValues + valueCount;
+
+    if (chunk.kind == CHUNK_STRING) {
+        offset += extraCount * sizeof(int64_t);
+        chunk.strings.resize(rowCount);
+        for (uint64_t row = 0; row < rowCount; row++) {
+            chunk.strings[row] = chunk.loaded.data() + offset;
+            offset += chunk.loadedExtra[row];
+        }
+        if (offset > length)
+            return false;
+    }
+
+    return true;
+}
+
+/* set the field's vector to rowCount loaded rows starting at firstRow */
+static void fillChunkRows(StripeChunk &chunk, uint64_t firstRow, uint64_t rowCount) {
+    orc::ColumnVectorBatch *vector = chunk.vector;
+
+    vector->numElements = rowCount;
+    vector->hasNulls = chunk.header.hasNulls;
+    if (vector->hasNulls)
+        memcpy(vector->notNull.data(), chunk.loaded.data() + sizeof(ChunkHeader) + firstRow, rowCount);
+
+    switch (chunk.kind) {
+        case CHUNK_LONG:
+            memcpy(static_cast<orc::LongVectorBatch *>(vector)->data.data(), chunk.loadedValues + firstRow,
+                   rowCount * sizeof(int64_t));
+            break;
+        case CHUNK_DOUBLE:
+            memcpy(static_cast<orc::DoubleVectorBatch *>(vector)->data.data(), chunk.loadedValues + firstRow,
+                   rowCount * sizeof(double));
+            break;
+        case CHUNK_TIMESTAMP:
+            memcpy(static_cast<orc::TimestampVectorBatch *>(vector)->data.data(), chunk.loadedValues + firstRow,
+                   rowCount * sizeof(int64_t));
+            memcpy(static_cast<orc::TimestampVectorBatch *>(vector)->nanoseconds.data(),
+                   chunk.loadedExtra + firstRow, rowCount * sizeof(int64_t));
+            break;
+        case CHUNK_STRING:
+            memcpy(static_cast<orc::StringVectorBatch *>(vector)->data.data(), &chunk.strings[firstRow],
+                   rowCount * sizeof(char *));
+            memcpy(static_cast<orc::StringVectorBatch *>(vector)->length.data(), chunk.loadedExtra + firstRow,
+                   rowCount * sizeof(int64_t));
+            break;
+    }
+}
+
+/*
+ * Thrown while the backend waits for a worker and an interrupt is pending.
+ * Nothing of the scan has moved yet, getOrcNextBatch() processes the
+ * interrupt once back in C and asks again.
+ */
+class OrcInterrupted : public std::exception {
+public:
+    const char *what() const throw() {
+        return "interrupted";
+    }
+};
+
+/*
+ * Decodes the stripes of a scan ahead of the backend on worker threads. The
+ * included fields are split into column groups, and a stripe is decoded group
+ * by group, so its streams are decompressed by as many workers at once. Each
+ * worker is bound to one group, there are at least as many workers as groups,
+ * and keeps a single orc reader over its fields on the orc lib's default
+ * memory pool, as nothing on a worker may call into postgres. It turns the
+ * group's fields into serialized chunks, the format of the shared chunk cache.
+ * The workers of a group claim its parts in stripe order, a stripe waits in a
+ * ring of one slot per worker until all its groups are done and the backend
+ * takes it, in the same order.
+ * The ring is synchronized by atomics only, a side with nothing to do backs
+ * off by sleeping. None of this memory is seen by postgres, so the chunks
+ * waiting for the backend are held to memoryLimit bytes: past it, only the
+ * stripe the backend takes next is started.
+ */
+class StripeReadAhead {
+public:
+    /* groups lists the positions in included of each group's fields, ascending, at most threadCount of them */
+    StripeReadAhead(const std::string &fileName, const std::string &fileTail, const std::list<int64_t> &included,
+                    const std::vector<std::vector<size_t> > &groups, const std::vector<uint64_t> &stripes,
+                    const std::vector<uint64_t> &stripeFirstRow, uint64_t rowCount,
+                    unsigned int threadCount, unsigned int batchRows, size_t memoryLimit)
+        : fileName(fileName), fileTail(fileTail), included(included.begin(), included.end()),
+          groups(groups), stripes(stripes), stripeFirstRow(stripeFirstRow), rowCount(rowCount),
+          batchRows(batchRows), memoryLimit(memoryLimit), slotCount(threadCount), slots(new Slot[threadCount]),
+          nextClaims(new std::atomic<uint64_t>[groups.size()]), consumed(0), heldBytes(0), stopping(false),
+          nextTake(0) {
+        sigset_t blocked;
+        sigset_t previous;
+
+        for (size_t i = 0; i < slotCount; i++)
+            resetSlot(slots[i]);
+        for (size_t i = 0; i < groups.size(); i++)
+            nextClaims[i].store(0, std::memory_order_relaxed);
+
+        /* the threads inherit the mask, postgres' signal handlers must only run on the backend's thread */
+        sigfillset(&blocked);
+        pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+        try {
+            for (unsigned int i = 0; i < threadCount; i++)
+                workers.push_back(std::thread(&StripeReadAhead::work, this, i % groups.size()));
+        }
+        catch (...) {
+            pthread_sigmask(SIG_SETMASK, &previous, NULL);
+            stop();
+            throw;
+        }
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    }
+
+    ~StripeReadAhead() {
+        stop();
+    }
+
+    /*
+     * Take the chunks of a stripe, one per included field, by swapping them
+     * with the given buffers, which are freed. The stripes before it are
+     * dropped. false if the stripe isn't read ahead, the error of a worker
+     * which failed on it is thrown here. A pending interrupt throws
+     * OrcInterrupted before the wait, no stripe is taken then.
+     */
+    bool take(uint64_t stripe, std::vector<std::vector<char> > &chunks) {
+        while (nextTake < stripes.size() && stripes[nextTake] <= stripe) {
+            Slot &slot = slots[nextTake % slotCount];
+            bool wanted = (stripes[nextTake] == stripe);
+            unsigned int waits = 0;
+            std::string error;
+
+            while (!slot.ready.load(std::memory_order_acquire)) {
+                if (InterruptPending && InterruptHoldoffCount == 0 && CritSectionCount == 0)
+                    throw OrcInterrupted();
+                backOff(waits++);
+            }
+
+            for (size_t i = 0; i < slot.errors.size() && error.empty(); i++)
+                error = slot.errors[i];
+            heldBytes.fetch_sub(slotBytes(slot), std::memory_order_relaxed);
+            if (wanted && error.empty()) {
+                chunks.resize(included.size());
+                chunks.swap(slot.chunks);
+            }
+
+            /* published to the workers by consumed */
+            resetSlot(slot);
+            nextTake++;
+            consumed.store(nextTake, std::memory_order_release);
+
+            if (wanted && !error.empty())
+                throw std::runtime_error(error);
+            if (wanted)
+                return true;
+        }
+
+        return false;
+    }
+
+private:
+    struct Slot {
+        std::atomic<bool> ready;
+        std::atomic<size_t> partsLeft;              /* groups still being decoded */
+        std::vector<std::vector<char> > chunks;     /* per included field, each group fills its own */
+        std::vector<std::string> errors;            /* per group */
+    };
+
+    /* what a worker keeps to decode one group */
+    struct GroupDecoder {
+        std::unique_ptr<orc::Reader> reader;
+        std::unique_ptr<orc::ColumnVectorBatch> batch;
+        std::vector<StripeChunk> chunks;
+        std::string error;                          /* of setting it up */
+    };
+
+    std::string fileName;
+    std::string fileTail;
+    std::vector<int64_t> included;
+    std::vector<std::vector<size_t> > groups;
+    std::vector<uint64_t> stripes;                  /* to decode, ascending */
+    std::vector<uint64_t> stripeFirstRow;
+    uint64_t rowCount;
+    unsigned int batchRows;
+    size_t memoryLimit;
+
+    size_t slotCount;
+    std::unique_ptr<Slot[]> slots;                  /* stripes[i] goes to slot i % slotCount */
+    std::unique_ptr<std::atomic<uint64_t>[]> nextClaims;  /* per group, the next stripes[] index */
+    std::atomic<uint64_t> consumed;                 /* stripes the backend is done with */
+    std::atomic<size_t> heldBytes;                  /* of the chunks in the slots */
+    std::atomic<bool> stopping;
+    std::vector<std::thread> workers;
+    uint64_t nextTake;                              /* the backend's own copy of consumed */
+
+    /* spin a little, then yield, then sleep, waiting for the other side */
+    static void backOff(unsigned int waits) {
+        if (waits < 64)
+            return;
+        if (waits < 128)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    /* the buffers are freed rather than reused, so an idle slot holds nothing */
+    void resetSlot(Slot &slot) {
+        slot.ready.store(false, std::memory_order_relaxed);
+        slot.partsLeft.store(groups.size(), std::memory_order_relaxed);
+        slot.chunks.assign(included.size(), std::vector<char>());
+        slot.errors.assign(groups.size(), std::string());
+    }
+
+    static size_t slotBytes(const Slot &slot) {
+        size_t bytes = 0;
+
+        for (size_t i = 0; i < slot.chunks.size(); i++)
+            bytes += slot.chunks[i].size();
+        return bytes;
+    }
+
+    void stop() {
+        stopping.store(true);
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+    }
+
+    /* open a reader on the group's fields only, exceptions are kept in the decoder */
+    void setUpGroup(size_t group, GroupDecoder &decoder) {
+        try {
+            orc::ReaderOptions opts;
+            std::list<int64_t> include;
+
+            for (size_t i = 0; i < groups[group].size(); i++)
+                include.push_back(included[groups[group][i]]);
+
+            opts.setSerializedFileTail(fileTail);
+            opts.include(include);
+            decoder.reader = orc::createReader(orc::readLocalFile(fileName), opts);
+            decoder.batch = decoder.reader->createRowBatch(batchRows);
+
+            orc::StructVectorBatch &rowBatch = dynamic_cast<orc::StructVectorBatch &>(*decoder.batch);
+            if (rowBatch.fields.size() != groups[group].size())
+                throw std::logic_error("column group doesn't match the file");
+
+            decoder.chunks.resize(rowBatch.fields.size());
+            for (size_t i = 0; i < decoder.chunks.size(); i++) {
+                decoder.chunks[i].vector = rowBatch.fields[i];
+                decoder.chunks[i].column = 0;
+                if (!chunkKindOf(decoder.chunks[i].vector, &decoder.chunks[i].kind))
+                    throw std::logic_error("column type can't be read ahead");
+            }
+        }
+        catch (std::exception &e) {
+            decoder.error = e.what();
+        }
+        catch (...) {
+            decoder.error = "unknown error";
+        }
+
+        if (!decoder.reader && decoder.error.empty())
+            decoder.error = "unknown error";
+    }
+
+    void work(size_t group) {
+        GroupDecoder decoder;
+
+        for (;;) {
+            uint64_t index = nextClaims[group].fetch_add(1);
+            unsigned int waits = 0;
+
+            if (index >= stripes.size())
+                return;
+
+            /*
+             * The slot is free once the backend took the stripe slotCount
+             * before. Over the memory limit, only the stripe the backend
+             * waits for is decoded, so the scan goes on at its own pace.
+             */
+            for (;;) {
+                uint64_t taken = consumed.load(std::memory_order_acquire);
+
+                if (index < taken + slotCount &&
+                    (index == taken || heldBytes.load(std::memory_order_relaxed) < memoryLimit))
+                    break;
+                if (stopping.load(std::memory_order_relaxed))
+                    return;
+                backOff(waits++);
+            }
+
+            Slot &slot = slots[index % slotCount];
+
+            /* exceptions must not leave the thread, a failure is passed on with the stripe */
+            if (!decoder.reader && decoder.error.empty())
+                setUpGroup(group, decoder);
+
+            slot.errors[group] = decoder.error;
+            if (decoder.error.empty()) {
+                try {
+                    decodeGroup(decoder, group, stripes[index], slot.chunks);
+                }
+                catch (std::exception &e) {
+                    slot.errors[group] = e.what();
+                }
+                catch (...) {
+                    slot.errors[group] = "unknown error";
+                }
+            }
+            if (stopping.load(std::memory_order_relaxed))
+                return;
+
+            for (size_t i = 0; i < groups[group].size(); i++)
+                heldBytes.fetch_add(slot.chunks[groups[group][i]].size(), std::memory_order_relaxed);
+
+            /* the last group done hands the stripe over */
+            if (slot.partsLeft.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                slot.ready.store(true, std::memory_order_release);
+        }
+    }
+
+    /* decode the group's fields over a whole stripe and serialize them into their places of out */
+    void decodeGroup(GroupDecoder &decoder, size_t group, uint64_t stripe, std::vector<std::vector<char> > &out) {
+        std::vector<StripeChunk> &chunks = decoder.chunks;
+        uint64_t firstRow = stripeFirstRow[stripe];
+        uint64_t endRow = (stripe + 1 < stripeFirstRow.size()) ? stripeFirstRow[stripe + 1] : rowCount;
+
+        for (size_t i = 0; i < chunks.size(); i++) {
+            chunks[i].notNull.clear();
+            chunks[i].values.clear();
+            chunks[i].extra.clear();
+            chunks[i].bytes.clear();
+            chunks[i].hasNulls = false;
+        }
+
+        /* at the stripe's first row this skips nothing */
+        decoder.reader->seekToRow(firstRow);
+        for (uint64_t row = firstRow; row < endRow && !stopping.load(std::memory_order_relaxed); ) {
+            if (!decoder.reader->next(*decoder.batch))
+                break;
+
+            uint64_t batchRowCount = std::min<uint64_t>(decoder.batch->numElements, endRow - row);
+
+            for (size_t i = 0; i < chunks.size(); i++)
+                appendChunkRows(chunks[i], batchRowCount);
+            row += batchRowCount;
+        }
+
+        for (size_t i = 0; i < chunks.size(); i++)
+            serializeChunk(chunks[i], out[groups[group][i]]);
+    }
+};
+
+static double columnWeight(const orc::Type &type, const orc::Statistics &statistics);
+
+class OrcReader {
+public:
+/*global variable*/
+    unsigned int colNum;
+    unsigned int maxRowPerBatch;
+    std::string line;
+
+    /* declared before opts/reader/batch, so it outlives them */
+    PgMemoryPool pool;
+    orc::ReaderOptions opts;
+
+    std::unique_ptr<orc::Reader> reader;
+    std::unique_ptr<orc::ColumnVectorBatch> batch;
+    std::vector<ColumnConverter> converters;
+    BatchArena arena;
+
+    /* stripe pruning, stripeSelected is empty without a search argument */
+    std::unique_ptr<SearchArgument> argument;
+    std::vector<uint64_t> stripeFirstRow;
+    std::vector<bool> stripeSelected;
+    uint64_t stripesSkipped;
+    /* parsed on first use, a parameterized scan prunes again on every rescan */
+    std::vector<std::unique_ptr<orc::Statistics> > stripeStatistics;
+    int sortColumn;                 /* fdw column the stripes ascend by, -1 if none */
+    uint64_t selectedStripeBegin;   /* stripes outside [begin, end) are not selected */
+    uint64_t selectedStripeEnd;
+
+    std::string fileName;
+    std::string serializedTail;     /* empty until asked for or passed in */
+    std::list<int64_t> included;
+    bool countOnly;         /* no column projected, rows are counted, not read */
+    uint64_t nextRow;       /* file row number the next batch starts at */
+    uint64_t selectedEnd;   /* end of the selected rows starting at nextRow */
+    uint64_t readerRow;     /* file row number the reader is at */
+    uint64_t batchRow;      /* file row number of the first row in batch */
+    uint64_t batchRows;     /* rows batch holds, before the cut at selectedEnd */
+    uint64_t batchOffset;   /* leading batch rows before nextRow, not returned */
+
+    /* shared stripe cursor of a parallel scan, claimStripe is NULL without */
+    OrcStripeClaim claimStripe;
+    void *claimArgument;
+    uint64_t claimedStripe;         /* last stripe claimed, UINT64_MAX if none */
+
+    /* first rows of the sampled blocks in file order, used by ANALYZE */
+    bool sampling;
+    std::vector<uint64_t> sampleBlocks;
+    size_t nextSampleBlock;
+
+    /* comparisons evaluated on the raw batch, rows lists the batch rows passing them */
+    std::vector<BatchFilter> filters;
+    std::vector<uint8_t> match;
+    std::vector<uint32_t> selection;
+    std::vector<uint32_t> allRows;
+    uint64_t rowsFiltered;
+
+    /* decoded stripes shared with other backends, chunks is empty without the cache */
+    OrcChunkKey chunkKey;           /* of the file, stripe and column are set per lookup */
+    size_t chunkMaxLength;
+    std::vector<StripeChunk> chunks;
+    uint64_t chunkStripe;           /* stripe last looked up, UINT64_MAX if none */
+    bool chunkStripeCached;         /* all its chunks were found */
+    uint64_t buildStripe;           /* stripe whose rows are being collected, UINT64_MAX if none */
+    uint64_t buildRow;              /* file row the next collected batch must start at */
+    uint64_t stripesCached;
+
+    /* whole stripes decoded by worker threads, readAhead is NULL without */
+    unsigned int readAheadThreads;
+    size_t readAheadMemory;         /* bytes the decoded stripes may wait in */
+    bool readAheadStarted;          /* for this pass, it may have found too little to do */
+    std::unique_ptr<StripeReadAhead> readAhead;
+    std::vector<StripeChunk> aheadChunks;           /* over batch, one per included field */
+    std::vector<std::vector<size_t> > aheadGroups;  /* positions in aheadChunks decoded together */
+    std::vector<std::vector<char> > aheadBuffers;   /* freed by the next take */
+    uint64_t aheadStripe;           /* stripe last taken, UINT64_MAX if none */
+    bool aheadStripeLoaded;
+    uint64_t stripesReadAhead;
+
+    /* init global var, should be used in BeginForeignScan() */
+    OrcReader(const char* filename, unsigned int fdwColNum, unsigned int fdwMaxRowPerBatch,
+              const Oid *typeIds, const int32 *typeMods, const bool *projected, bool *textFallback,
+              MemoryContext batchContext, MemoryContext decodeContext,
+              const char *fileTail, size_t fileTailLength)
+        : pool(decodeContext), arena(batchContext), stripesSkipped(0), sortColumn(-1),
+          selectedStripeBegin(0), selectedStripeEnd(0), fileName(filename),
+          nextRow(0), selectedEnd(0), readerRow(0), batchRow(0), batchRows(0),
+          batchOffset(0), claimStripe(NULL), claimArgument(NULL),
+          claimedStripe(UINT64_MAX), sampling(false), nextSampleBlock(0),
+          rowsFiltered(0), chunkMaxLength(0),
+          chunkStripe(UINT64_MAX), chunkStripeCached(false), buildStripe(UINT64_MAX), buildRow(0),
+          stripesCached(0), readAheadThreads(0), readAheadMemory(0), readAheadStarted(false), aheadStripe(UINT64_MAX),
+          aheadStripeLoaded(false), stripesReadAhead(0) {
+        colNum = fdwColNum;
+        maxRowPerBatch = fdwMaxRowPerBatch;
+
+        opts.setMemoryPool(pool);
+
+        /* a serialized tail saves reading and parsing the footer again */
+        if (fileTail != NULL) {
+            serializedTail.assign(fileTail, fileTailLength);
+            opts.setSerializedFileTail(serializedTail);
+        }
+
+        /*
+         * fdw column i is the i-th field of the orc root struct. Only the
+         * projected fields are included, so the streams of all other columns
+         * are never read nor decompressed. include() takes 1-based field
+         * numbers of the root struct and ignores the ones beyond its end.
+         */
+        std::list<int64_t> include;
+        for (unsigned int i = 0; i < colNum; i++) {
+            if (projected[i] && typeIds[i] != InvalidOid)
+                include.push_back(i + 1);
+        }
+
+        /*
+         * Without columns, e.g. for count(*) or EXISTS, the batches are sized
+         * from the stripes' row counts and no stream is read at all. The
+         * reader still wants a field to be created with.
+         */
+        countOnly = include.empty();
+        if (countOnly)
+            include.push_back(1);
+        opts.include(include);
+        included = include;
+
+        reader = orc::createReader(orc::readLocalFile(std::string(filename)), opts);
+        batch = reader->createRowBatch(maxRowPerBatch);
+
+        /* the row batch only has the included fields, in field order */
+        const orc::Type &rowType = reader->getType();
+        orc::StructVectorBatch &rowBatch = dynamic_cast<orc::StructVectorBatch &>(*batch);
+        unsigned int batchField = 0;
+
+        converters.resize(colNum);
+        for (unsigned int i = 0; i < colNum; i++) {
+            ColumnConverter &converter = converters[i];
+
+            converter.kind = (i < rowType.getSubtypeCount()) ? rowType.getSubtype(i).getKind() : orc::STRUCT;
+            converter.typeId = typeIds[i];
+            converter.typeMod = typeMods[i];
+            converter.vector = NULL;
+            converter.arena = &arena;
+
+            bool selected = projected[i] && typeIds[i] != InvalidOid && i < rowType.getSubtypeCount();
+
+            if (!selected || batchField >= rowBatch.fields.size()) {
+                converter.kernel = convertNullColumn;
+            }
+            else {
+                converter.kernel = resolveKernel(rowType.getSubtype(i).getKind(), typeIds[i]);
+                converter.vector = rowBatch.fields[batchField++];
+            }
+
+            if (converter.kernel == convertTextColumn)
+                converter.printer = createColumnPrinter(line, rowType.getSubtype(i));
+
+            textFallback[i] = (converter.kernel == convertTextColumn);
+        }
+
+        match.resize(maxRowPerBatch);
+        selection.resize(maxRowPerBatch);
+        allRows.resize(maxRowPerBatch);
+        for (unsigned int row = 0; row < maxRowPerBatch; row++)
+            allRows[row] = row;
+
+        uint64_t firstRow = 0;
+        for (uint64_t stripe = 0; stripe < reader->getNumberOfStripes(); stripe++) {
+            stripeFirstRow.push_back(firstRow);
+            firstRow += reader->getStripe(stripe)->getNumberOfRows();
+        }
+
+        setupChunkCache();
+    }
+
+    /* one chunk per included field, if the cache is set up and takes all of them */
+    void setupChunkCache() {
+        struct stat statBuffer;
+
+        chunkMaxLength = OrcChunkCacheMaxLength();
+        if (chunkMaxLength == 0 || countOnly || stat(fileName.c_str(), &statBuffer) != 0)
+            return;
+
+        memset(&chunkKey, 0, sizeof(chunkKey));
+        chunkKey.device = statBuffer.st_dev;
+        chunkKey.inode = statBuffer.st_ino;
+        chunkKey.size = statBuffer.st_size;
+        chunkKey.mtime = statBuffer.st_mtime;
+
+        if (!buildStripeChunks(chunks))
+            chunks.clear();
+    }
+
+    /* one chunk over each included field of batch, false if a field's type has no chunk format */
+    bool buildStripeChunks(std::vector<StripeChunk> &out) {
+        const orc::Type &rowType = reader->getType();
+        orc::StructVectorBatch &rowBatch = dynamic_cast<orc::StructVectorBatch &>(*batch);
+        size_t batchField = 0;
+
+        for (std::list<int64_t>::iterator field = included.begin();
+             field != included.end() && batchField < rowBatch.fields.size(); ++field) {
+            StripeChunk chunk;
+
+            chunk.vector = rowBatch.fields[batchField++];
+            chunk.column = (uint32_t) rowType.getSubtype(*field - 1).getColumnId();
+            chunk.hasNulls = false;
+            if (!chunkKindOf(chunk.vector, &chunk.kind))
+                return false;
+            out.push_back(chunk);
+        }
+
+        return true;
+    }
+
+    /*
+     * Decode stripes ahead on threadCount worker threads, 0 stops it. Each
+     * stripe is split into up to columnGroups groups of fields, balanced by
+     * their estimated sizes, which are decoded by different workers at once.
+     * There are no more groups than workers, each worker keeps to one.
+     * The decoded stripes waiting for the scan are held to memoryLimit bytes.
+     */
+    void setReadAhead(unsigned int threadCount, unsigned int columnGroups, size_t memoryLimit) {
+        stopReadAhead();
+        aheadChunks.clear();
+        aheadGroups.clear();
+        readAheadThreads = 0;
+        readAheadMemory = memoryLimit;
+
+        if (threadCount == 0 || countOnly || !buildStripeChunks(aheadChunks)) {
+            aheadChunks.clear();
+            return;
+        }
+        readAheadThreads = threadCount;
+
+        std::unique_ptr<orc::Statistics> statistics = reader->getStatistics();
+        const orc::Type &rowType = reader->getType();
+        std::vector<std::pair<double, size_t> > weights;
+        std::list<int64_t>::const_iterator field = included.begin();
+
+        for (size_t position = 0; position < aheadChunks.size(); position++, ++field)
+            weights.push_back(std::make_pair(columnWeight(rowType.getSubtype(*field - 1), *statistics), position));
+
+        /* the heaviest field goes to the lightest group */
+        size_t groupCount = std::max<size_t>(1, std::min<size_t>(std::min(columnGroups, threadCount),
+                                                                 weights.size()));
+        std::vector<double> groupWeight(groupCount, 0);
+
+        std::sort(weights.rbegin(), weights.rend());
+        aheadGroups.resize(groupCount);
+        for (size_t i = 0; i < weights.size(); i++) {
+            size_t lightest = std::min_element(groupWeight.begin(), groupWeight.end()) - groupWeight.begin();
+
+            aheadGroups[lightest].push_back(weights[i].second);
+            groupWeight[lightest] += weights[i].first;
+        }
+        for (size_t i = 0; i < groupCount; i++)
+            std::sort(aheadGroups[i].begin(), aheadGroups[i].end());
+    }
+
+    /*
+     * Start the workers on the stripes this pass selects, unless there are too
+     * few of them to be worth the threads, e.g. for the pass of a nested loop.
+     */
+    void startReadAhead() {
+        std::vector<uint64_t> stripes;
+
+        readAheadStarted = true;
+        if (sampling || claimStripe != NULL)
+            return;
+
+        for (uint64_t stripe = 0; stripe < stripeFirstRow.size(); stripe++) {
+            if (stripeEndOf(stripe) == stripeFirstRow[stripe])
+                continue;
+            if (!stripeSelected.empty() &&
+                (stripe < selectedStripeBegin || stripe >= selectedStripeEnd || !stripeSelected[stripe]))
+                continue;
+            stripes.push_back(stripe);
+        }
+
+        if (stripes.size() < 2)
+            return;
+
+        /* include() ignored the fields past the end of the file's, the chunks don't have them */
+        std::list<int64_t> fields(included);
+        fields.resize(aheadChunks.size());
+
+        readAhead.reset(new StripeReadAhead(fileName, getSerializedTail(), fields, aheadGroups, stripes,
+                                            stripeFirstRow, reader->getNumberOfRows(), readAheadThreads,
+                                            maxRowPerBatch, readAheadMemory));
+    }
+
+    /* join the workers, the next pass starts them again */
+    void stopReadAhead() {
+        readAhead.reset();
+        readAheadStarted = false;
+        aheadStripe = UINT64_MAX;
+        aheadStripeLoaded = false;
+    }
+
+    ~OrcReader() {
+        /* the workers use nothing of ours, but must be gone before the backend moves on */
+        readAhead.reset();
+
+        /* the decode context is deleted right after us, skip the single frees */
+        pool.bulkRelease = true;
+
+        /* converters hold printers which point into batch */
+        converters.clear();
+        batch.reset();
+        reader.reset();
+    }
+
+    /*
+     * Mark the stripes whose statistics exclude the search argument, NULL
+     * clears it. The comparisons at its top level which can be evaluated
+     * exactly on the raw vectors become batch filters, filtered tells which.
+     */
+    void setSearchArgument(const SearchArgument *searchArgument, bool *filtered) {
+        uint64_t stripeCount = reader->getNumberOfStripes();
+        const orc::Type &rowType = reader->getType();
+        std::vector<int64_t> fieldColumnIds(colNum, -1);
+
+        for (unsigned int i = 0; i < colNum && i < rowType.getSubtypeCount(); i++)
+            fieldColumnIds[i] = rowType.getSubtype(i).getColumnId();
+
+        stopReadAhead();
+        argument.reset();
+        stripeSelected.clear();
+        stripesSkipped = 0;
+        filters.clear();
+        rowsFiltered = 0;
+
+        if (searchArgument == NULL)
+            return;
+        argument.reset(new SearchArgument(*searchArgument));
+
+        if (argument->op == ORC_PREDICATE_AND) {
+            for (size_t i = 0; i < argument->children.size(); i++)
+                filtered[i] = addBatchFilter(argument->children[i]);
+        }
+        else
+            filtered[0] = addBatchFilter(*argument);
+
+        /* files written without stripe statistics can't be pruned by stripe */
+        bool haveStatistics = (reader->getNumberOfStripeStatistics() == stripeCount);
+
+        /* in a sorted file, the comparisons on the sort key bound a run of stripes */
+        selectedStripeBegin = 0;
+        selectedStripeEnd = stripeCount;
+        if (haveStatistics && sortColumn >= 0) {
+            if (argument->op == ORC_PREDICATE_AND) {
+                for (size_t i = 0; i < argument->children.size(); i++)
+                    narrowSortedStripes(argument->children[i], fieldColumnIds);
+            }
+            else
+                narrowSortedStripes(*argument, fieldColumnIds);
+        }
+
+        for (uint64_t stripe = 0; stripe < stripeCount; stripe++) {
+            bool selected = (stripe >= selectedStripeBegin && stripe < selectedStripeEnd);
+
+            if (selected && haveStatistics)
+                selected = searchArgumentMayMatch(*argument, stripeStatisticsOf(stripe), fieldColumnIds);
+
+            stripeSelected.push_back(selected);
+            stripesSkipped += selected ? 0 : 1;
+        }
+    }
+
+    const orc::Statistics &stripeStatisticsOf(uint64_t stripe) {
+        if (stripeStatistics.empty())
+            stripeStatistics.resize(reader->getNumberOfStripes());
+        if (!stripeStatistics[stripe])
+            stripeStatistics[stripe] = reader->getStripeStatistics(stripe);
+        return *stripeStatistics[stripe];
+    }
+
+    /*
+     * Narrow the selected run of stripes to those a comparison on the sort
+     * column admits. The stripes' min and max ascend, so the bounds are found
+     * by binary search and only O(log n) stripe statistics are parsed.
+     */
+    void narrowSortedStripes(const SearchArgument &comparison, const std::vector<int64_t> &fieldColumnIds) {
+        if (comparison.op > ORC_PREDICATE_GE || (int) comparison.column != sortColumn ||
+            fieldColumnIds[comparison.column] < 0)
+            return;
+
+        uint32_t columnId = (uint32_t) fieldColumnIds[comparison.column];
+        SearchArgument bound(comparison);
+
+        /* below the lower bound, the stripes' max is too small */
+        if (comparison.op == ORC_PREDICATE_EQ || comparison.op == ORC_PREDICATE_GT ||
+            comparison.op == ORC_PREDICATE_GE) {
+            bound.op = (comparison.op == ORC_PREDICATE_GT) ? ORC_PREDICATE_GT : ORC_PREDICATE_GE;
+            selectedStripeBegin = partitionPoint(selectedStripeBegin, selectedStripeEnd, [&](uint64_t stripe) {
+                const orc::Statistics &statistics = stripeStatisticsOf(stripe);
+
+                return columnId < statistics.getNumberOfColumns() &&
+                       !statisticsMayMatch(bound, statistics.getColumnStatistics(columnId));
+            });
+        }
+
+        /* past the upper bound, the stripes' min is too large */
+        if (comparison.op == ORC_PREDICATE_EQ || comparison.op == ORC_PREDICATE_LT ||
+            comparison.op == ORC_PREDICATE_LE) {
+            bound.op = (comparison.op == ORC_PREDICATE_LT) ? ORC_PREDICATE_LT : ORC_PREDICATE_LE;
+            selectedStripeEnd = partitionPoint(selectedStripeBegin, selectedStripeEnd, [&](uint64_t stripe) {
+                const orc::Statistics &statistics = stripeStatisticsOf(stripe);
+
+                return columnId >= statistics.getNumberOfColumns() ||
+                       statisticsMayMatch(bound, statistics.getColumnStatistics(columnId));
+            });
+        }
+    }
+
+    /*
+     * Evaluate a comparison on the raw vector of its column if that gives the
+     * same answer as postgres comparing the converted Datums: integers, dates
+     * and doubles which reach the Datum unrounded.
+     */
+    bool addBatchFilter(const SearchArgument &comparison) {
+        if (comparison.op > ORC_PREDICATE_GE || comparison.column >= colNum)
+            return false;
+
+        const ColumnConverter &converter = converters[comparison.column];
+        if (converter.vector == NULL || converter.kernel == convertTextColumn)
+            return false;
+
+        BatchFilter filter;
+        filter.vector = converter.vector;
+        filter.longConstant = 0;
+        filter.doubleConstant = 0;
+
+        switch (comparison.kind) {
+            case ORC_VALUE_INT:
+                if (converter.typeId != INT2OID && converter.typeId != INT4OID && converter.typeId != INT8OID)
+                    return false;
+                filter.isDouble = false;
+                filter.longConstant = comparison.intValue;
+                break;
+            case ORC_VALUE_DATE:
+                if (converter.typeId != DATEOID)
+                    return false;
+                /* orc dates are days since 1970-01-01 */
+                filter.isDouble = false;
+                filter.longConstant = comparison.intValue + (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE);
+                break;
+            case ORC_VALUE_DOUBLE:
+                /* a double read into float4 is rounded before postgres compares it */
+                if (converter.typeId != FLOAT8OID && !(converter.typeId == FLOAT4OID && converter.kind == orc::FLOAT))
+                    return false;
+                filter.isDouble = true;
+                filter.doubleConstant = comparison.doubleValue;
+                break;
+            default:
+                return false;
+        }
+
+        filter.kernel = resolveFilterKernel(filter.isDouble, filter.isDouble && std::isnan(filter.doubleConstant),
+                                            comparison.op);
+        filters.push_back(filter);
+        return true;
+    }
+
+    /* the stripe a file row is in, batches never span stripes */
+    uint64_t stripeOf(uint64_t row) const {
+        return std::upper_bound(stripeFirstRow.begin(), stripeFirstRow.end(), row) - stripeFirstRow.begin() - 1;
+    }
+
+    uint64_t stripeEndOf(uint64_t stripe) const {
+        return (stripe + 1 < stripeFirstRow.size()) ? stripeFirstRow[stripe + 1] : reader->getNumberOfRows();
+    }
+
+    /*
+     * Move nextRow past the pruned stripes, selectedEnd is set
+     * to the end of the selected rows that start at nextRow. false means no
+     * row is left.
+     */
+    bool skipToSelectedRows() {
+        uint64_t rowCount = reader->getNumberOfRows();
+
+        /* a sample is a list of blocks, each read by a batch of its own */
+        if (sampling) {
+            if (nextRow < selectedEnd)
+                return true;
+            if (nextSampleBlock == sampleBlocks.size()) {
+                nextRow = rowCount;
+                return false;
+            }
+            nextRow = sampleBlocks[nextSampleBlock++];
+            selectedEnd = std::min<uint64_t>(nextRow + maxRowPerBatch, stripeEndOf(stripeOf(nextRow)));
+            return true;
+        }
+
+        selectedEnd = rowCount;
+        while (nextRow < rowCount) {
+            /* a participant of a parallel scan only reads the stripes it claimed */
+            if (claimStripe != NULL && !moveToClaimedStripe())
+                break;
+            if (stripeSelected.empty())
+                break;
+
+            uint64_t stripe = stripeOf(nextRow);
+
+            /* jump straight to the run of stripes the sort key admits */
+            if (stripe < selectedStripeBegin) {
+                nextRow = stripeFirstRow[selectedStripeBegin];
+                continue;
+            }
+            if (stripe >= selectedStripeEnd) {
+                nextRow = rowCount;
+                break;
+            }
+
+            uint64_t stripeEnd = stripeEndOf(stripe);
+
+            if (!stripeSelected[stripe]) {
+                nextRow = stripeEnd;
+                continue;
+            }
+
+            selectedEnd = stripeEnd;
+            break;
+        }
+
+        /* past the claimed stripe the next one is claimed */
+        if (claimStripe != NULL && nextRow < rowCount)
+            selectedEnd = std::min(selectedEnd, stripeEndOf(claimedStripe));
+
+        return nextRow < rowCount;
+    }
+
+    /*
+     * Claim stripes until one holds nextRow or lies past it, and move nextRow
+     * to its start. The claims of all participants ascend, so a stripe this
+     * one has moved past was pruned, and whoever claims a stripe reads all of
+     * it. false once every stripe is claimed.
+     */
+    bool moveToClaimedStripe() {
+        uint64_t rowCount = reader->getNumberOfRows();
+
+        while (nextRow < rowCount && (claimedStripe == UINT64_MAX || stripeOf(nextRow) != claimedStripe)) {
+            uint64_t stripe = claimStripe(claimArgument);
+
+            if (stripe >= stripeFirstRow.size()) {
+                nextRow = rowCount;
+                break;
+            }
+
+            claimedStripe = stripe;
+            if (stripeFirstRow[stripe] > nextRow)
+                nextRow = stripeFirstRow[stripe];
+        }
+
+        return nextRow < rowCount;
+    }
+
+    /* read the next batch from the chunk cache or the file, false means end of file */
+    bool nextBatch() {
+        if (!skipToSelectedRows())
+            return false;
+
+        uint64_t stripe = stripeOf(nextRow);
+
+        if (countOnly) {
+            uint64_t end = std::min(selectedEnd, stripeEndOf(stripe));
+
+            batch->numElements = std::min<uint64_t>(maxRowPerBatch, end - nextRow);
+            nextRow += batch->numElements;
+            return batch->numElements > 0;
+        }
+
+        if (readAheadThreads > 0 && !readAheadStarted)
+            startReadAhead();
+
+        if (nextRow >= batchRow && nextRow < batchRow + batchRows) {
+            /* a run of selected rows may start inside the batch read for the last one */
+            batch->numElements = batchRows;
+        }
+        else if (readCachedRows(stripe) || readAheadRows(stripe)) {
+            batchRow = nextRow;
+            batchRows = batch->numElements;
+        }
+        else {
+            /*
+             * seekToRow() starts the stripe over and skips to the row, so it
+             * is only used to enter a stripe. Inside one the reader reads on
+             * and the batches before nextRow are dropped.
+             */
+            if (readerRow > nextRow || stripeOf(readerRow) != stripe) {
+                reader->seekToRow(nextRow);
+                readerRow = nextRow;
+            }
+
+            do {
+                if (!reader->next(*batch)) {
+                    batchRows = 0;
+                    return false;
+                }
+                collectStripeRows(stripe);
+                batchRow = readerRow;
+                readerRow += batch->numElements;
+            } while (readerRow <= nextRow);
+            batchRows = batch->numElements;
+        }
+
+        /* rows past the selected ones are cut, those before them are skipped by selectRows() */
+        uint64_t batchEnd = std::min(batchRow + batchRows, selectedEnd);
+
+        batchOffset = nextRow - batchRow;
+        batch->numElements = batchEnd - batchRow;
+        nextRow = batchEnd;
+
+        for (unsigned int i = 0; i < colNum; i++) {
+            if (converters[i].printer)
+                converters[i].printer->reset(*converters[i].vector);
+        }
+
+        return batch->numElements > batchOffset;
+    }
+
+    /* read the next batch and convert it column by column.
+     * return: false means no next record.
+    * */
+    bool OrcGetNextBatch(OrcBatch *out) {
+        const uint32_t *rows = NULL;
+        uint64_t rowCount = 0;
+
+        arena.reset();
+
+        /* batches whose rows all fail the filters are never converted */
+        while (rowCount == 0) {
+            if (!nextBatch()) {
+                out->rowCount = 0;
+                return false;
+            }
+            rowCount = selectRows(&rows);
+        }
+
+        for (unsigned int i = 0; i < colNum; i++)
+            converters[i].kernel(converters[i], rows, rowCount, out->values[i], out->nulls[i]);
+        out->rowCount = (unsigned int) rowCount;
+
+        return true;
+    }
+
+    /*
+     * Run the batch filters, rows is set to the batch rows from batchOffset
+     * on passing all of them.
+     */
+    uint64_t selectRows(const uint32_t **rows) {
+        uint64_t rowCount = batch->numElements;
+
+        if (filters.empty()) {
+            *rows = allRows.data() + batchOffset;
+            return rowCount - batchOffset;
+        }
+
+        uint8_t *matches = match.data();
+        memset(matches, 1, rowCount);
+
+        for (size_t i = 0; i < filters.size(); i++) {
+            const BatchFilter &filter = filters[i];
+            const void *data = NULL;
+            const void *constant = NULL;
+
+            if (filter.isDouble) {
+                data = static_cast<const orc::DoubleVectorBatch *>(filter.vector)->data.data();
+                constant = &filter.doubleConstant;
+            }
+            else {
+                data = static_cast<const orc::LongVectorBatch *>(filter.vector)->data.data();
+                constant = &filter.longConstant;
+            }
+            filter.kernel(data, rowCount, constant, matches);
+
+            /* a comparison with null is never true */
+            if (filter.vector->hasNulls) {
+                const char *notNull = filter.vector->notNull.data();
+
+                for (uint64_t row = 0; row < rowCount; row++)
+                    matches[row] &= (notNull[row] != 0);
+            }
+        }
+
+        uint32_t *selected = selection.data();
+        uint64_t selectedCount = 0;
+
+        for (uint64_t row = batchOffset; row < rowCount; row++) {
+            selected[selectedCount] = (uint32_t) row;
+            selectedCount += matches[row];
+        }
+
+        rowsFiltered += rowCount - batchOffset - selectedCount;
+        *rows = selected;
+        return selectedCount;
+    }
+
+    /* fill the batch from the cached chunks of the stripe, false if they aren't all cached */
+    bool readCachedRows(uint64_t stripe) {
+        if (chunks.empty())
+            return false;
+
+        if (chunkStripe != stripe) {
+            chunkStripe = stripe;
+            chunkStripeCached = loadStripeChunks(stripe);
+            stripesCached += chunkStripeCached ? 1 : 0;
+        }
+        if (!chunkStripeCached)
+            return false;
+
+        uint64_t rowCount = std::min<uint64_t>(maxRowPerBatch, stripeEndOf(stripe) - nextRow);
+
+        for (size_t i = 0; i < chunks.size(); i++)
+            fillChunkRows(chunks[i], nextRow - stripeFirstRow[stripe], rowCount);
+        batch->numElements = rowCount;
+        return true;
+    }
+
+    /* fill the batch from the stripe as decoded by a worker, false if it wasn't read ahead */
+    bool readAheadRows(uint64_t stripe) {
+        if (!readAhead)
+            return false;
+
+        if (aheadStripe != stripe) {
+            uint64_t rowCount = stripeEndOf(stripe) - stripeFirstRow[stripe];
+
+            /* set once taken, an interrupted take() is asked again */
+            aheadStripeLoaded = readAhead->take(stripe, aheadBuffers);
+            aheadStripe = stripe;
+            for (size_t i = 0; i < aheadChunks.size() && aheadStripeLoaded; i++) {
+                aheadChunks[i].loaded.swap(aheadBuffers[i]);
+                aheadStripeLoaded = attachChunk(aheadChunks[i], aheadChunks[i].loaded.size(), rowCount);
+            }
+            stripesReadAhead += aheadStripeLoaded ? 1 : 0;
+        }
+        if (!aheadStripeLoaded)
+            return false;
+
+        uint64_t rowCount = std::min<uint64_t>(maxRowPerBatch, stripeEndOf(stripe) - nextRow);
+
+        for (size_t i = 0; i < aheadChunks.size(); i++)
+            fillChunkRows(aheadChunks[i], nextRow - stripeFirstRow[stripe], rowCount);
+        batch->numElements = rowCount;
+        return true;
+    }
+
+    bool loadStripeChunks(uint64_t stripe) {
+        uint64_t rowCount = stripeEndOf(stripe) - stripeFirstRow[stripe];
+
+        for (size_t i = 0; i < chunks.size(); i++) {
+            StripeChunk &chunk = chunks[i];
+            OrcChunkKey key = chunkKey;
+            Size length = 0;
+
+            key.stripe = (uint32) stripe;
+            key.column = chunk.column;
+
+            if (!OrcChunkCacheLookup(&key, chunk.loaded.data(), chunk.loaded.size(), &length))
+                return false;
+
+            /* too long for the buffer, nothing was copied */
+            if (length > chunk.loaded.size()) {
+                chunk.loaded.resize(length);
+                if (!OrcChunkCacheLookup(&key, chunk.loaded.data(), chunk.loaded.size(), &length))
+                    return false;
+            }
+
+            if (!attachChunk(chunk, length, rowCount))
+                return false;
+        }
+
+        return true;
+    }
+
+    /*
+     * Add the batch just read to the chunks of its stripe. Only stripes read
+     * from their first row to their last without a seek are cached, the
+     * others and those with a chunk too long for the cache are dropped.
+     */
+    void collectStripeRows(uint64_t stripe) {
+        uint64_t rowCount = batch->numElements;
+
+        if (chunks.empty())
+            return;
+
+        if (readerRow == stripeFirstRow[stripe]) {
+            buildStripe = stripe;
+            for (size_t i = 0; i < chunks.size(); i++) {
+                chunks[i].notNull.clear();
+                chunks[i].values.clear();
+                chunks[i].extra.clear();
+                chunks[i].bytes.clear();
+                chunks[i].hasNulls = false;
+            }
+        }
+        else if (buildStripe != stripe || buildRow != readerRow)
+            return;
+
+        buildRow = readerRow + rowCount;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            appendChunkRows(chunks[i], rowCount);
+            if (chunkLength(chunks[i]) > chunkMaxLength) {
+                dropCollectedRows();
+                return;
+            }
+        }
+
+        if (buildRow == stripeEndOf(stripe)) {
+            std::vector<char> chunk;
+
+            for (size_t i = 0; i < chunks.size(); i++) {
+                OrcChunkKey key = chunkKey;
+
+                key.stripe = (uint32) stripe;
+                key.column = chunks[i].column;
+                serializeChunk(chunks[i], chunk);
+                OrcChunkCacheInsert(&key, chunk.data(), chunk.size());
+            }
+            dropCollectedRows();
+        }
+    }
+
+    void dropCollectedRows() {
+        buildStripe = UINT64_MAX;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            std::vector<char>().swap(chunks[i].notNull);
+            std::vector<int64_t>().swap(chunks[i].values);
+            std::vector<int64_t>().swap(chunks[i].extra);
+            std::vector<char>().swap(chunks[i].bytes);
+        }
+    }
+
+    /*
+     * Pick the blocks of a sample of about targetRows rows. a block is
+     * maxRowPerBatch rows of one stripe, the last one of a stripe may be
+     * shorter, and every block is equally likely to be picked. they are picked
+     * in file order by selection sampling, Knuth's algorithm S. the orc lib
+     * seeks by skipping from the start of the stripe, so nextBatch() seeks
+     * only to the first block of a stripe and reads on to the others, the
+     * batches between them are dropped unconverted. blocks start at multiples
+     * of maxRowPerBatch from the stripe's first row, where those batches end.
+     */
+    uint64_t setSample(uint64_t targetRows, unsigned int seed) {
+        uint64_t rowCount = reader->getNumberOfRows();
+
+        stopReadAhead();
+        sampleBlocks.clear();
+        nextSampleBlock = 0;
+        sampling = false;
+        nextRow = 0;
+        selectedEnd = 0;
+        if (targetRows >= rowCount)
+            return rowCount;
+
+        uint64_t blockCount = 0;
+        for (uint64_t stripe = 0; stripe < stripeFirstRow.size(); stripe++)
+            blockCount += (stripeEndOf(stripe) - stripeFirstRow[stripe] + maxRowPerBatch - 1) / maxRowPerBatch;
+
+        uint64_t wanted = std::min<uint64_t>(blockCount, (targetRows + maxRowPerBatch - 1) / maxRowPerBatch);
+        std::mt19937_64 generator(seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        uint64_t seen = 0;
+
+        for (uint64_t stripe = 0; stripe < stripeFirstRow.size() && sampleBlocks.size() < wanted; stripe++) {
+            uint64_t stripeEnd = stripeEndOf(stripe);
+
+            for (uint64_t row = stripeFirstRow[stripe]; row < stripeEnd && sampleBlocks.size() < wanted;
+                 row += maxRowPerBatch, seen++) {
+                if ((blockCount - seen) * uniform(generator) < wanted - sampleBlocks.size())
+                    sampleBlocks.push_back(row);
+            }
+        }
+
+        sampling = true;
+        return rowCount;
+    }
+
+    /* start over from the first row, nextBatch() seeks there */
+    void rescan() {
+        nextRow = 0;
+        selectedEnd = 0;
+        nextSampleBlock = 0;
+        claimedStripe = UINT64_MAX;
+        stopReadAhead();
+
+        /* stripes collected by the last pass may be cached by now */
+        chunkStripe = UINT64_MAX;
+    }
+
+    const std::string &getSerializedTail() {
+        if (serializedTail.empty())
+            serializedTail = reader->getSerializedFileTail();
+        return serializedTail;
+    }
+
+    void OrcGetScanStats(OrcScanStats *stats) {
+        stats->peakMemory = pool.peak;
+        stats->stripeCount = reader->getNumberOfStripes();
+        stats->stripesSkipped = stripesSkipped;
+        stats->rowsFiltered = rowsFiltered;
+        stats->stripesCached = stripesCached;
+        stats->stripesReadAhead = stripesReadAhead;
+    }
+};
+
+/*
+ * What the fdw holds for one scan. It lives in the scan's decode context, the
+ * reader itself is c++ heap memory and is deleted by releaseOrcReader(), or by
+ * the reset callback when the scan is aborted.
+ */
+struct OrcReaderHandle {
+    OrcReader *reader;
+    unsigned int readAheadFds;  /* descriptors counted for the read-ahead workers */
+#if PG_VERSION_NUM >= 90500
+    MemoryContextCallback callback;
+#endif
+};
+
+/* hand back the descriptors counted by setOrcReadAhead() */
+static void releaseReadAheadFds(OrcReaderHandle *handle) {
+#if PG_VERSION_NUM >= 130000
+    for (; handle->readAheadFds > 0; handle->readAheadFds--)
+        ReleaseExternalFD();
+#endif
+    handle->readAheadFds = 0;
+}
+
+/* message of the last c++ exception caught in a wrapper function */
+static char orcErrorMessage[1024];
+
+/*
+ * Rethrow the caught c++ exception as a postgres ERROR. Must be called after
+ * leaving the catch block, so no c++ frame is skipped by the longjmp.
+ */
+static void reportOrcError(const char* filename) {
+    ereport(ERROR,
+            (errcode(ERRCODE_FDW_ERROR),
+             errmsg("could not read orc file \"%s\": %s", filename, orcErrorMessage)));
+}
+
+static void saveOrcError(const std::exception &e) {
+    snprintf(orcErrorMessage, sizeof(orcErrorMessage), "%s", e.what());
+}
+
+#if PG_VERSION_NUM >= 90500
+/*
+ * Runs when the scan's decode context goes away. After an ERROR the scan
+ * never reaches EndForeignScan(), so the reader is dropped here instead of
+ * being left behind with buffers pointing into freed memory.
+ */
+static void releaseOrcReaderCallback(void *arg) {
+    OrcReaderHandle *handle = (OrcReaderHandle *) arg;
+
+    delete handle->reader;
+    handle->reader = NULL;
+    releaseReadAheadFds(handle);
+}
+#endif
+
+/* does every value in [min, max] satisfy "value op constant"? */
+template <typename T>
+static bool rangeAllMatch(OrcPredicateOp op, const T &min, const T &max, const T &constant) {
+    switch (op) {
+        case ORC_PREDICATE_EQ:
+            return !(min < constant) && !(constant < min) && !(max < constant) && !(constant < max);
+        case ORC_PREDICATE_LT:
+            return max < constant;
+        case ORC_PREDICATE_LE:
+            return !(constant < max);
+        case ORC_PREDICATE_GT:
+            return constant < min;
+        case ORC_PREDICATE_GE:
+            return !(min < constant);
+        default:
+            return false;
+    }
+}
+
+/*
+ * Does every one of rowCount rows with the given column statistics satisfy
+ * the comparison? Nulls never do. A NaN may hide from a double column's
+ * min/max, its sum gives it away.
+ */
+static bool statisticsAllMatch(const SearchArgument &argument, const orc::ColumnStatistics *statistics,
+                               uint64_t rowCount) {
+    if (statistics == NULL || statistics->getNumberOfValues() != rowCount)
+        return false;
+
+    switch (argument.kind) {
+        case ORC_VALUE_INT: {
+            const orc::IntegerColumnStatistics *stats =
+                dynamic_cast<const orc::IntegerColumnStatistics *>(statistics);
+
+            if (stats == NULL || !stats->hasMinimum() || !stats->hasMaximum())
+                return false;
+            return rangeAllMatch<int64_t>(argument.op, stats->getMinimum(), stats->getMaximum(),
+                                          argument.intValue);
+        }
+        case ORC_VALUE_DOUBLE: {
+            const orc::DoubleColumnStatistics *stats =
+                dynamic_cast<const orc::DoubleColumnStatistics *>(statistics);
+
+            if (stats == NULL || !stats->hasMinimum() || !stats->hasMaximum() || !stats->hasSum()
+                || std::isnan(stats->getMinimum()) || std::isnan(stats->getMaximum())
+                || std::isnan(stats->getSum()) || std::isnan(argument.doubleValue))
+                return false;
+            return rangeAllMatch<double>(argument.op, stats->getMinimum(), stats->getMaximum(),
+                                         argument.doubleValue);
+        }
+        case ORC_VALUE_STRING: {
+            const orc::StringColumnStatistics *stats =
+                dynamic_cast<const orc::StringColumnStatistics *>(statistics);
+
+            if (stats == NULL || !stats->hasMinimum() || !stats->hasMaximum())
+                return false;
+            return rangeAllMatch<std::string>(argument.op, stats->getMinimum(), stats->getMaximum(),
+                                              argument.stringValue);
+        }
+        case ORC_VALUE_DATE: {
+            const orc::DateColumnStatistics *stats =
+                dynamic_cast<const orc::DateColumnStatistics *>(statistics);
+
+            if (stats == NULL || !stats->hasMinimum() || !stats->hasMaximum())
+                return false;
+            return rangeAllMatch<int64_t>(argument.op, stats->getMinimum(), stats->getMaximum(),
+                                          argument.intValue + (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE));
+        }
+        case ORC_VALUE_TIMESTAMP: {
+            const orc::TimestampColumnStatistics *stats =
+                dynamic_cast<const orc::TimestampColumnStatistics *>(statistics);
+
+            if (stats == NULL || !stats->hasMinimum() || !stats->hasMaximum())
+                return false;
+            int64_t constant;
+            if (!unixMicrosOf(argument.intValue, &constant))
+                return false;
+            /* the values lie anywhere in the milliseconds of min and max */
+            return rangeAllMatch<int64_t>(argument.op, stats->getMinimum() * 1000,
+                                          stats->getMaximum() * 1000 + 999, constant);
+        }
+    }
+
+    return false;
+}
+
+/* the counterpart of searchArgumentMayMatch(), can no row of the stripe fail the argument? */
+static bool searchArgumentAllMatch(const SearchArgument &argument, const orc::Statistics &statistics,
+                                   const std::vector<int64_t> &fieldColumnIds, uint64_t rowCount) {
+    switch (argument.op) {
+        case ORC_PREDICATE_AND:
+            for (size_t i = 0; i < argument.children.size(); i++) {
+                if (!searchArgumentAllMatch(argument.children[i], statistics, fieldColumnIds, rowCount))
+                    return false;
+            }
+            return true;
+        case ORC_PREDICATE_OR:
+            for (size_t i = 0; i < argument.children.size(); i++) {
+                if (searchArgumentAllMatch(argument.children[i], statistics, fieldColumnIds, rowCount))
+                    return true;
+            }
+            return false;
+        default: {
+            if (argument.column >= fieldColumnIds.size() || fieldColumnIds[argument.column] < 0)
+                return false;
+
+            uint32_t columnId = (uint32_t) fieldColumnIds[argument.column];
+            if (columnId >= statistics.getNumberOfColumns())
+                return false;
+
+            return statisticsAllMatch(argument, statistics.getColumnStatistics(columnId), rowCount);
+        }
+    }
+}
+
+/* can the values of an orc column be read as the kind of value? */
+static bool valueKindFits(OrcValueKind valueKind, orc::TypeKind kind) {
+    switch (valueKind) {
+        case ORC_VALUE_INT:
+            return kind == orc::BYTE || kind == orc::SHORT || kind == orc::INT || kind == orc::LONG;
+        case ORC_VALUE_DOUBLE:
+            return kind == orc::FLOAT || kind == orc::DOUBLE;
+        case ORC_VALUE_STRING:
+            return kind == orc::STRING || kind == orc::VARCHAR || kind == orc::CHAR;
+        case ORC_VALUE_DATE:
+            return kind == orc::DATE;
+        case ORC_VALUE_TIMESTAMP:
+            return kind == orc::TIMESTAMP;
+    }
+    return false;
+}
+
+/* does every comparison fit its column, so rowMayMatch() is exact? */
+static bool searchArgumentFits(const SearchArgument &argument, const orc::Type &rowType) {
+    if (argument.op == ORC_PREDICATE_AND || argument.op == ORC_PREDICATE_OR) {
+        for (size_t i = 0; i < argument.children.size(); i++) {
+            if (!searchArgumentFits(argument.children[i], rowType))
+                return false;
+        }
+        return true;
+    }
+
+    return argument.column < rowType.getSubtypeCount() &&
+           valueKindFits(argument.kind, rowType.getSubtype(argument.column).getKind());
+}
+
+/*
+ * Aggregates of a query without GROUP BY. The stripes whose statistics prove
+ * that all or none of their rows satisfy the search argument are answered by
+ * those statistics, only the others are decoded, and of them only the
+ * aggregated and compared columns.
+ */
+class OrcAggregator {
+public:
+    OrcAggregator(const char *filename, unsigned int colNum, const char *fileTail, size_t fileTailLength,
+                  const SearchArgument *argument, const OrcAggregate *aggregates, unsigned int aggregateCount)
+        : fileName(filename), colNum(colNum), argument(argument), aggregates(aggregates),
+          aggregateCount(aggregateCount), folds(aggregateCount) {
+        orc::ReaderOptions opts;
+
+        if (fileTail != NULL)
+            opts.setSerializedFileTail(std::string(fileTail, fileTailLength));
+
+        reader = orc::createReader(orc::readLocalFile(fileName), opts);
+
+        const orc::Type &rowType = reader->getType();
+        fieldColumnIds.assign(colNum, -1);
+        for (unsigned int i = 0; i < colNum && i < rowType.getSubtypeCount(); i++)
+            fieldColumnIds[i] = rowType.getSubtype(i).getColumnId();
+
+        uint64_t firstRow = 0;
+        for (uint64_t stripe = 0; stripe < reader->getNumberOfStripes(); stripe++) {
+            stripeFirstRow.push_back(firstRow);
+            stripeRows.push_back(reader->getStripe(stripe)->getNumberOfRows());
+            firstRow += stripeRows.back();
+        }
+    }
+
+    /* false if an aggregated or compared column doesn't fit its type in the file */
+    bool fits() const {
+        const orc::Type &rowType = reader->getType();
+
+        for (unsigned int i = 0; i < aggregateCount; i++) {
+            if (aggregates[i].kind == ORC_AGGREGATE_COUNT_ROWS)
+                continue;
+            if (aggregates[i].column >= colNum || aggregates[i].column >= rowType.getSubtypeCount() ||
+                !valueKindFits(aggregates[i].valueKind, rowType.getSubtype(aggregates[i].column).getKind()))
+                return false;
+        }
+
+        return argument == NULL || searchArgumentFits(*argument, rowType);
+    }
+
+    bool correctStatistics() const {
+        return reader->hasCorrectStatistics();
+    }
+
+    /* sort the stripes into skipped, answered and decoded ones, and fold the answered ones */
+    void plan(OrcAggregateStats *stats) {
+        uint64_t stripeCount = reader->getNumberOfStripes();
+        bool haveStatistics = reader->hasCorrectStatistics() &&
+                              reader->getNumberOfStripeStatistics() == stripeCount;
+        std::vector<std::unique_ptr<orc::Statistics> > statistics(stripeCount);
+        std::vector<uint64_t> answerable;
+
+        memset(stats, 0, sizeof(OrcAggregateStats));
+        stats->stripeCount = stripeCount;
+        decoded.clear();
+
+        for (uint64_t stripe = 0; stripe < stripeCount; stripe++) {
+            if (!haveStatistics) {
+                decoded.push_back(stripe);
+                continue;
+            }
+
+            statistics[stripe] = reader->getStripeStatistics(stripe);
+            if (argument != NULL && !searchArgumentMayMatch(*argument, *statistics[stripe], fieldColumnIds))
+                stats->stripesSkipped++;
+            else if (argument == NULL ||
+                     searchArgumentAllMatch(*argument, *statistics[stripe], fieldColumnIds, stripeRows[stripe]))
+                answerable.push_back(stripe);
+            else
+                decoded.push_back(stripe);
+        }
+
+        /*
+         * Timestamp statistics are in milliseconds, so min and max of a stripe
+         * aren't its values. Only the stripes sharing the extreme millisecond
+         * can hold the result and are decoded, the others add nothing.
+         */
+        for (unsigned int i = 0; i < aggregateCount; i++) {
+            folds[i].boundFound = false;
+            if (aggregates[i].valueKind != ORC_VALUE_TIMESTAMP ||
+                (aggregates[i].kind != ORC_AGGREGATE_MIN && aggregates[i].kind != ORC_AGGREGATE_MAX))
+                continue;
+
+            for (size_t j = 0; j < answerable.size(); j++) {
+                const orc::TimestampColumnStatistics *column = dynamic_cast<const orc::TimestampColumnStatistics *>(
+                    columnStatistics(*statistics[answerable[j]], aggregates[i].column));
+                int64_t value = 0;
+
+                if (column == NULL || column->getNumberOfValues() == 0 ||
+                    !column->hasMinimum() || !column->hasMaximum())
+                    continue;
+
+                value = (aggregates[i].kind == ORC_AGGREGATE_MIN) ? column->getMinimum() : column->getMaximum();
+                if (!folds[i].boundFound || (aggregates[i].kind == ORC_AGGREGATE_MIN ? value < folds[i].bound
+                                                                                     : folds[i].bound < value))
+                    folds[i].bound = value;
+                folds[i].boundFound = true;
+            }
+        }
+
+        for (size_t j = 0; j < answerable.size(); j++) {
+            uint64_t stripe = answerable[j];
+
+            if (foldStatistics(*statistics[stripe], stripeRows[stripe], false)) {
+                foldStatistics(*statistics[stripe], stripeRows[stripe], true);
+                stats->stripesAnswered++;
+            }
+            else
+                decoded.push_back(stripe);
+        }
+
+        std::sort(decoded.begin(), decoded.end());
+        stats->stripesDecoded = decoded.size();
+        for (size_t j = 0; j < decoded.size(); j++)
+            stats->rowsDecoded += stripeRows[decoded[j]];
+    }
+
+    /* fold the rows of the stripes plan() left, which satisfy the search argument */
+    void decode() {
+        if (decoded.empty())
+            return;
+
+        std::set<unsigned int> columns;
+        std::list<int64_t> include;
+
+        for (unsigned int i = 0; i < aggregateCount; i++) {
+            if (aggregates[i].kind != ORC_AGGREGATE_COUNT_ROWS)
+                columns.insert(aggregates[i].column);
+        }
+        if (argument != NULL)
+            searchArgumentColumns(*argument, columns);
+        for (std::set<unsigned int>::iterator column = columns.begin(); column != columns.end(); ++column)
+            include.push_back(*column + 1);
+
+        /* counting rows still takes a batch */
+        if (include.empty())
+            include.push_back(1);
+
+        orc::ReaderOptions opts;
+        opts.include(include);
+        opts.setSerializedFileTail(reader->getSerializedFileTail());
+
+        std::unique_ptr<orc::Reader> rowReader = orc::createReader(orc::readLocalFile(fileName), opts);
+        std::unique_ptr<orc::ColumnVectorBatch> batch = rowReader->createRowBatch(1024);
+        orc::StructVectorBatch &rowBatch = dynamic_cast<orc::StructVectorBatch &>(*batch);
+        const orc::Type &rowType = rowReader->getType();
+        unsigned int batchField = 0;
+
+        /* the batch only has the included fields, in field order */
+        fields.assign(colNum, NULL);
+        kinds.assign(colNum, orc::STRUCT);
+        for (std::list<int64_t>::iterator field = include.begin(); field != include.end(); ++field) {
+            unsigned int column = (unsigned int) (*field - 1);
+
+            if (column >= colNum || column >= rowType.getSubtypeCount())
+                continue;
+            fields[column] = rowBatch.fields[batchField++];
+            kinds[column] = rowType.getSubtype(column).getKind();
+        }
+
+        for (size_t j = 0; j < decoded.size(); j++) {
+            uint64_t remaining = stripeRows[decoded[j]];
+
+            rowReader->seekToRow(stripeFirstRow[decoded[j]]);
+            while (remaining > 0 && rowReader->next(*batch)) {
+                uint64_t rowCount = std::min(remaining, (uint64_t) batch->numElements);
+
+                for (uint64_t row = 0; row < rowCount; row++) {
+                    if (argument == NULL || rowMayMatch(*argument, fields, kinds, row))
+                        foldRow(row);
+                }
+                remaining -= rowCount;
+            }
+        }
+    }
+
+    void results(OrcAggregate *out) {
+        /* the strings are returned by pointer, until the next call */
+        static std::vector<std::string> resultStrings;
+
+        resultStrings.resize(aggregateCount);
+        for (unsigned int i = 0; i < aggregateCount; i++) {
+            const Fold &fold = folds[i];
+            OrcAggregate &aggregate = out[i];
+
+            if (aggregate.kind == ORC_AGGREGATE_COUNT_ROWS || aggregate.kind == ORC_AGGREGATE_COUNT) {
+                aggregate.isNull = false;
+                aggregate.intValue = fold.count;
+                continue;
+            }
+
+            resultStrings[i] = fold.stringValue;
+            aggregate.isNull = !fold.found;
+            aggregate.intValue = fold.intValue;
+            aggregate.doubleValue = fold.doubleValue;
+            aggregate.stringValue = resultStrings[i].data();
+            aggregate.stringLength = resultStrings[i].size();
+        }
+    }
+
+private:
+    struct Fold {
+        int64_t count;
+        bool found;                 /* a value was folded into intValue etc. */
+        int64_t intValue;           /* INT, DATE and TIMESTAMP, in postgres units */
+        double doubleValue;
+        std::string stringValue;
+        bool boundFound;            /* timestamp min/max, the extreme millisecond */
+        int64_t bound;
+
+        Fold() : count(0), found(false), intValue(0), doubleValue(0), boundFound(false), bound(0) {}
+    };
+
+    const orc::ColumnStatistics *columnStatistics(const orc::Statistics &statistics, unsigned int column) const {
+        if (column >= fieldColumnIds.size() || fieldColumnIds[column] < 0 ||
+            (uint64_t) fieldColumnIds[column] >= statistics.getNumberOfColumns())
+            return NULL;
+        return statistics.getColumnStatistics((uint32_t) fieldColumnIds[column]);
+    }
+
+    static void foldInt(Fold &fold, OrcAggregateKind kind, int64_t value) {
+        if (kind == ORC_AGGREGATE_SUM && fold.found) {
+            if ((value > 0 && fold.intValue > std::numeric_limits<int64_t>::max() - value) ||
+                (value < 0 && fold.intValue < std::numeric_limits<int64_t>::min() - value))
+                throw std::range_error("bigint out of range");
+            fold.intValue += value;
+        }
+        else if (!fold.found || (kind == ORC_AGGREGATE_MIN ? value < fold.intValue : fold.intValue < value))
+            fold.intValue = value;
+        fold.found = true;
+    }
+
+    static void foldDouble(Fold &fold, OrcAggregateKind kind, double value) {
+        if (kind == ORC_AGGREGATE_SUM && fold.found)
+            fold.doubleValue += value;
+        else if (!fold.found || (kind == ORC_AGGREGATE_MIN ? compareDoubles(value, fold.doubleValue) < 0
+                                                           : compareDoubles(value, fold.doubleValue) > 0))
+            fold.doubleValue = value;
+        fold.found = true;
+    }
+
+    static void foldString(Fold &fold, OrcAggregateKind kind, const char *data, size_t length) {
+        int cmp = fold.stringValue.compare(0, std::string::npos, data, length);
+
+        if (!fold.found || (kind == ORC_AGGREGATE_MIN ? cmp > 0 : cmp < 0))
+            fold.stringValue.assign(data, length);
+        fold.found = true;
+    }
+
+    /*
+     * Fold the statistics of a stripe all of whose rows satisfy the search
+     * argument, or, without apply, check that they answer every aggregate.
+     */
+    bool foldStatistics(const orc::Statistics &statistics, uint64_t rowCount, bool apply) {
+        for (unsigned int i = 0; i < aggregateCount; i++) {
+            const OrcAggregate &aggregate = aggregates[i];
+            Fold &fold = folds[i];
+
+            if (aggregate.kind == ORC_AGGREGATE_COUNT_ROWS) {
+                fold.count += apply ? rowCount : 0;
+                continue;
+            }
+
+            const orc::ColumnStatistics *column = columnStatistics(statistics, aggregate.column);
+            if (column == NULL)
+                return false;
+
+            if (aggregate.kind == ORC_AGGREGATE_COUNT) {
+                fold.count += apply ? column->getNumberOfValues() : 0;
+                continue;
+            }
+
+            /* all null, nothing to fold */
+            if (column->getNumberOfValues() == 0)
+                continue;
+
+            if (!foldColumnStatistics(aggregate, fold, column, apply))
+                return false;
+        }
+
+        return true;
+    }
+
+    static bool foldColumnStatistics(const OrcAggregate &aggregate, Fold &fold,
+                                     const orc::ColumnStatistics *column, bool apply) {
+        bool minimum = (aggregate.kind == ORC_AGGREGATE_MIN);
+
+        switch (aggregate.valueKind) {
+            case ORC_VALUE_INT: {
+                const orc::IntegerColumnStatistics *stats = dynamic_cast<const orc::IntegerColumnStatistics *>(column);
+
+                if (stats == NULL || (aggregate.kind == ORC_AGGREGATE_SUM ? !stats->hasSum()
+                                                                          : !stats->hasMinimum() || !stats->hasMaximum()))
+                    return false;
+                if (apply)
+                    foldInt(fold, aggregate.kind, aggregate.kind == ORC_AGGREGATE_SUM ? stats->getSum() :
+                                                  minimum ? stats->getMinimum() : stats->getMaximum());
+                return true;
+            }
+            case ORC_VALUE_DOUBLE: {
+                const orc::DoubleColumnStatistics *stats = dynamic_cast<const orc::DoubleColumnStatistics *>(column);
+
+                /* a NaN sum is the answer of sum(), but min/max may have missed the NaN */
+                if (stats == NULL || !stats->hasSum())
+                    return false;
+                if (aggregate.kind != ORC_AGGREGATE_SUM &&
+                    (!stats->hasMinimum() || !stats->hasMaximum() || std::isnan(stats->getSum()) ||
+                     std::isnan(stats->getMinimum()) || std::isnan(stats->getMaximum())))
+                    return false;
+                if (apply)
+                    foldDouble(fold, aggregate.kind, aggregate.kind == ORC_AGGREGATE_SUM ? stats->getSum() :
+                                                     minimum ? stats->getMinimum() : stats->getMaximum());
+                return true;
+            }
+            case ORC_VALUE_STRING: {
+                const orc::StringColumnStatistics *stats = dynamic_cast<const orc::StringColumnStatistics *>(column);
+
+                if (stats == NULL || aggregate.kind == ORC_AGGREGATE_SUM || !stats->hasMinimum() || !stats->hasMaximum())
+                    return false;
+                if (apply) {
+                    const std::string &value = minimum ? stats->getMinimum() : stats->getMaximum();
+                    foldString(fold, aggregate.kind, value.data(), value.size());
+                }
+                return true;
+            }
+            case ORC_VALUE_DATE: {
+                const orc::DateColumnStatistics *stats = dynamic_cast<const orc::DateColumnStatistics *>(column);
+
+                if (stats == NULL || aggregate.kind == ORC_AGGREGATE_SUM || !stats->hasMinimum() || !stats->hasMaximum())
+                    return false;
+                /* orc dates are days since 1970-01-01 */
+                if (apply)
+                    foldInt(fold, aggregate.kind, (minimum ? stats->getMinimum() : stats->getMaximum())
+                                                  - (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE));
+                return true;
+            }
+            case ORC_VALUE_TIMESTAMP: {
+                const orc::TimestampColumnStatistics *stats =
+                    dynamic_cast<const orc::TimestampColumnStatistics *>(column);
+
+                /* see plan(), the stripe answers only by not holding the extreme millisecond */
+                if (stats == NULL || aggregate.kind == ORC_AGGREGATE_SUM || !stats->hasMinimum() ||
+                    !stats->hasMaximum() || !fold.boundFound)
+                    return false;
+                return minimum ? fold.bound < stats->getMinimum() : stats->getMaximum() < fold.bound;
+            }
+        }
+
+        return false;
+    }
+
+    void foldRow(uint64_t row) {
+        for (unsigned int i = 0; i < aggregateCount; i++) {
+            const OrcAggregate &aggregate = aggregates[i];
+            Fold &fold = folds[i];
+
+            if (aggregate.kind == ORC_AGGREGATE_COUNT_ROWS) {
+                fold.count++;
+                continue;
+            }
+
+            const orc::ColumnVectorBatch *vector = fields[aggregate.column];
+            if (vector->hasNulls && !vector->notNull.data()[row])
+                continue;
+
+            if (aggregate.kind == ORC_AGGREGATE_COUNT) {
+                fold.count++;
+                continue;
+            }
+
+            switch (aggregate.valueKind) {
+                case ORC_VALUE_INT:
+                    foldInt(fold, aggregate.kind, static_cast<const orc::LongVectorBatch *>(vector)->data.data()[row]);
+                    break;
+                case ORC_VALUE_DOUBLE:
+                    foldDouble(fold, aggregate.kind,
+                               static_cast<const orc::DoubleVectorBatch *>(vector)->data.data()[row]);
+                    break;
+                case ORC_VALUE_STRING: {
+                    const orc::StringVectorBatch *strings = static_cast<const orc::StringVectorBatch *>(vector);
+
+                    foldString(fold, aggregate.kind, strings->data.data()[row],
+                               (size_t) strings->length.data()[row]);
+                    break;
+                }
+                case ORC_VALUE_DATE:
+                    foldInt(fold, aggregate.kind, static_cast<const orc::LongVectorBatch *>(vector)->data.data()[row]
+                                                  - (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE));
+                    break;
+                case ORC_VALUE_TIMESTAMP: {
+                    /* the same conversion as convertTimestampColumn */
+                    const orc::TimestampVectorBatch *timestamps =
+                        static_cast<const orc::TimestampVectorBatch *>(vector);
+                    const int64_t epochOffset = (int64_t) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY;
+
+                    foldInt(fold, aggregate.kind, (timestamps->data.data()[row] - epochOffset) * USECS_PER_SEC
+                                                  + timestamps->nanoseconds.data()[row] / 1000);
+                    break;
+                }
+            }
+        }
+    }
+
+    std::string fileName;
+    unsigned int colNum;
+    const SearchArgument *argument;
+    const OrcAggregate *aggregates;
+    unsigned int aggregateCount;
+    std::vector<Fold> folds;
+
+    std::unique_ptr<orc::Reader> reader;
+    std::vector<int64_t> fieldColumnIds;
+    std::vector<uint64_t> stripeFirstRow;
+    std::vector<uint64_t> stripeRows;
+    std::vector<uint64_t> decoded;      /* stripes plan() left to decode() */
+
+    /* decode(), the vectors of the fdw columns in the batch */
+    std::vector<const orc::ColumnVectorBatch *> fields;
+    std::vector<orc::TypeKind> kinds;
+};
+
+// wrapper functions:
+
+/* open the file for one scan, should be used in BeginForeignScan() */
+OrcReaderHandle *initOrcReader(const char* filename, unsigned int fdwColNum, unsigned int fdwMaxRowPerBatch,
+                               const Oid *typeIds, const int32 *typeMods, const bool *projected,
+                               bool *textFallback, MemoryContext batchContext, MemoryContext decodeContext,
+                               const char *fileTail, size_t fileTailLength) {
+    bool failed = false;
+    OrcReaderHandle *handle = (OrcReaderHandle *)
+        MemoryContextAllocZero(decodeContext, sizeof(OrcReaderHandle));
+
+    try {
+        handle->reader = new OrcReader(filename, fdwColNum, fdwMaxRowPerBatch,
+                                       typeIds, typeMods, projected, textFallback,
+                                       batchContext, decodeContext, fileTail, fileTailLength);
+    }
+    catch (std::exception &e) {
+        saveOrcError(e);
+        failed = true;
+    }
+
+    if (failed)
+        reportOrcError(filename);
+
+#if PG_VERSION_NUM >= 90500
+    handle->callback.func = releaseOrcReaderCallback;
+    handle->callback.arg = handle;
+    MemoryContextRegisterResetCallback(decodeContext, &handle->callback);
+#endif
+
+    return handle;
+}
+
+/**
+ * Get the serialized tail of the scan's file, the bytes belong to the reader.
+ */
+void getOrcSerializedTail(OrcReaderHandle *handle, const char **fileTail, size_t *fileTailLength) {
+    bool failed = false;
+
+    *fileTail = NULL;
+    *fileTailLength = 0;
+
+    if (handle == NULL || handle->reader == NULL)
+        return;
+
+    OrcReader* orcreader = handle->reader;
+    try {
+        const std::string &tail = orcreader->getSerializedTail();
+
+        *fileTail = tail.data();
+        *fileTailLength = tail.size();
+    }
+    catch (std::exception &e) {
+        saveOrcError(e);
+        failed = true;
+    }
+
+    if (failed)
+        reportOrcError(orcreader->fileName.c_str());
+}
+
+/* restart the scan from the first row, should be used in ReScanForeignScan() */
+void rescanOrcReader(OrcReaderHandle *handle) {
+    if (handle == NULL || handle->reader == NULL)
+        return;
+
+    handle->reader->rescan();
+}
+
+/**
+ * make the scan return a sample of about targetRows rows, see the header.
+ * @return the number of rows in the file, 0 if it can't be read.
+ */
+unsigned long long setOrcSample(OrcReaderHandle *handle, unsigned long long targetRows, unsigned int seed) {
+    unsigned long long rowCount = 0;
+    bool failed = false;
+
+    if (handle == NULL || handle->reader == NULL)
+        return 0;
+
+    try {
+        rowCount = handle->reader->setSample(targetRows, seed);
+    }
+    catch (std::exception &e) {
+        saveOrcError(e);
+        failed = true;
+    }
+
+    if (failed)
+        reportOrcError(handle->reader->fileName.c_str());
+    return rowCount;
+}
+
+/**
+ * decode stripes ahead of the scan on worker threads, see the header.
+ */
+void setOrcReadAhead(OrcReaderHandle *handle, unsigned int threadCount, unsigned int columnGroups,
+                     size_t memoryLimit) {
+    bool failed = false;
+
+    if (handle == NULL || handle->reader == NULL)
+        return;
+
+#if PG_VERSION_NUM < 90500
+    /* without the reset callback an aborted scan would leave its threads running */
+    threadCount = 0;
+#endif
+
+    releaseReadAheadFds(handle);
+#if PG_VERSION_NUM >= 130000
+    /*
+     * every worker opens the file once, those count against
+     * max_files_per_process. fewer workers start if the backend can't spare
+     * the descriptors.
+     */
+    while (handle->readAheadFds < threadCount && AcquireExternalFD())
+        handle->readAheadFds++;
+    threadCount = handle->readAheadFds;
+#endif
+
+    try {
+        handle->reader->setReadAhead(threadCount, columnGroups, memoryLimit);
+    }
+    catch (std::exception &e) {
+        saveOrcError(e);
+        failed = true;
+    }
+
+    if (failed)
+        reportOrcError(handle->reader->fileName.c_str());
+}
+
+/**
+ * share the stripes of the scan with other processes, see the header.
+ */
+void setOrcStripeClaim(OrcReaderHandle *handle, OrcStripeClaim claim, void *argument) {
+    if (handle == NULL || handle->reader == NULL)
+        return;
+
+    /* the workers would decode the stripes of all participants */
+    handle->reader->stopReadAhead();
+    handle->reader->claimStripe = claim;
+    handle->reader->claimArgument = argument;
+    handle->reader->claimedStripe = UINT64_MAX;
+}
+
+/* release tuple memory, should be used in EndForeignScan() */
+void releaseOrcReader(OrcReaderHandle *handle) {
+    if (handle == NULL)
+        return;
+
+    delete handle->reader;
+    handle->reader = NULL;
+    releaseReadAheadFds(handle);
+}
+
+/**
+ * set the search argument used to skip stripes, should be used in BeginForeignScan()
+ */
+void setOrcSearchArgument(OrcReaderHandle *handle, const OrcPredicate *root, bool *filtered) {
+    bool failed = false;
+
+    if (handle == NULL || handle->reader == NULL)
+        return;
+
+    OrcReader* orcreader = handle->reader;
+    try {
+        if (root == NULL)
+            orcreader->setSearchArgument(NULL, filtered);
+        else {
+            SearchArgument argument(*root);
+            orcreader->setSearchArgument(&argument, filtered);
+        }
+    }
+    catch (std::exception &e) {
+        saveOrcError(e);
+        failed = true;
+    }
+
+    if (failed)
+        reportOrcError(orcreader->fileName.c_str());
+}
+
+/**
+ * read and convert the next row batch, should be used in IterativeForeignScan()
+ * @return: false means no next record.
+ */
+bool getOrcNextBatch(OrcReaderHandle *handle, OrcBatch *batch) {
+    bool found = false;
+    bool failed = false;
+
+    if (handle == NULL || handle->reader == NULL) {
+        batch->rowCount = 0;
+        return false;
+    }
+
+    OrcReader* orcreader = handle->reader;
+    for (;;) {
+        bool interrupted = false;
+
+        try {
+            found = orcreader->OrcGetNextBatch(batch);
+        }
+        catch (OrcInterrupted &) {
+            interrupted = true;
+        }
+        catch (std::exception &e) {
+            saveOrcError(e);
+            failed = true;
+        }
+
+        if (!interrupted)
+            break;
+
+        /* out of the c++ frames, a cancel raises its ERROR here */
+        CHECK_FOR_INTERRUPTS();
+    }
+
+    if (failed)
+        reportOrcError(orcreader->fileName.c_str());
+
+    return found;
+}
+
+/*
+ * Relative size of a column and its children within a stripe. The orc lib
+ * doesn't expose the stream lengths, so it is estimated from the file's
+ * column statistics: the total length of strings and binaries, the value
+ * count times the value width for everything else.
+ */
+static double columnWeight(const orc::Type &type, const orc::Statistics &statistics) {
+    const orc::ColumnStatistics *stats = NULL;
+    double values = 0;
+    double weight = 0;
+
+    if (type.getColumnId() < statistics.getNumberOfColumns())
+        stats = statistics.getColumnStatistics((uint32_t) type.getColumnId());
+    if (stats != NULL)
+        values = (double) stats->getNumberOfValues();
+
+    switch (type.getKind()) {
+        case orc::BOOLEAN:
+            weight = values / 8;
+            break;
+        case orc::BYTE:
+            weight = values;
+            break;
+        case orc::SHORT:
+            weight = values * 2;
+            break;
+        case orc::INT:
+        case orc::FLOAT:
+        case orc::DATE:
+            weight = values * 4;
+            break;
+        case orc::LONG:
+        case orc::DOUBLE:
+            weight = values * 8;
+            break;
+        case orc::TIMESTAMP:
+            weight = values * 12;
+            break;
+        case orc::DECIMAL:
+            weight = values * 16;
+            break;
+        case orc::STRING:
+        case orc::VARCHAR:
+        case orc::CHAR: {
+            const orc::StringColumnStatistics *stringStats =
+                dynamic_cast<const orc::StringColumnStatistics *>(stats);
+
+            weight = values * 4 + (stringStats ? (double) stringStats->getTotalLength() : values * 16);
+            break;
+        }
+        case orc::BINARY: {
+            const orc::BinaryColumnStatistics *binaryStats =
+                dynamic_cast<const orc::BinaryColumnStatistics *>(stats);
+
+            weight = values * 4 + (binaryStats ? (double) binaryStats->getTotalLength() : values * 16);
+            break;
+        }
+        case orc::LIST:
+        case orc::MAP:
+            /* the lengths stream */
+            weight = values * 4;
+            break;
+        default:
+            break;
+    }
+
+    for (uint64_t i = 0; i < type.getSubtypeCount(); i++)
+        weight += columnWeight(type.getSubtype(i), statistics);
+
+    return weight;
+}
+
+/*
+ * Share of the given stripes an equality on each column is expected to read,
+ * if the stripes are pruned by its min/max. A value uniformly drawn from the
+ * column's range falls into each stripe with the odds of the stripe's width,
+ * so key-clustered files get a small share and unsorted ones 1.
+ */
+static void estimateStripeFraction(const orc::Reader &reader, unsigned int colNum,
+                                   const std::vector<int64_t> &fieldColumnIds,
+                                   const std::vector<uint64_t> &stripes, double *stripeFraction) {
+    std::vector<double> minimum(colNum, 0), maximum(colNum, 0), width(colNum, 0);
+    std::vector<bool> known(colNum, !stripes.empty());
+
+    for (size_t i = 0; i < stripes.size(); i++) {
+        std::unique_ptr<orc::Statistics> statistics = reader.getStripeStatistics(stripes[i]);
+
+        for (unsigned int column = 0; column < colNum; column++) {
+            double stripeMinimum = 0;
+            double stripeMaximum = 0;
+
+            if (!known[column])
+                continue;
+            if (fieldColumnIds[column] < 0 || (uint64_t) fieldColumnIds[column] >= statistics->getNumberOfColumns()
+                || !numericRange(statistics->getColumnStatistics((uint32_t) fieldColumnIds[column]),
+                                 &stripeMinimum, &stripeMaximum)) {
+                known[column] = false;
+                continue;
+            }
+
+            minimum[column] = (i == 0) ? stripeMinimum : std::min(minimum[column], stripeMinimum);
+            maximum[column] = (i == 0) ? stripeMaximum : std::max(maximum[column], stripeMaximum);
+            width[column] += stripeMaximum - stripeMinimum;
+        }
+    }
+
+    for (unsigned int column = 0; column < colNum; column++) {
+        double range = maximum[column] - minimum[column];
+
+        stripeFraction[column] = 1;
+        if (known[column] && range > 0)
+            stripeFraction[column] = std::min(1.0, std::max(1.0, width[column] / range) / stripes.size());
+    }
+}
+
+/*
+ * Bytes a scan reads: the footer and the share of the projected columns in
+ * the data of each stripe the search argument doesn't rule out.
+ */
+static void estimateScan(const orc::Reader &reader, unsigned int colNum, const bool *projected,
+                         const SearchArgument *argument, OrcFileInfo *info, double *stripeFraction) {
+    const orc::Type &rowType = reader.getType();
+    std::unique_ptr<orc::Statistics> statistics = reader.getStatistics();
+    uint64_t stripeCount = reader.getNumberOfStripes();
+    double totalWeight = 0;
+    double projectedWeight = 0;
+    unsigned int projectedCount = 0;
+    std::vector<int64_t> fieldColumnIds(colNum, -1);
+
+    for (uint64_t field = 0; field < rowType.getSubtypeCount(); field++) {
+        double weight = columnWeight(rowType.getSubtype(field), *statistics);
+
+        totalWeight += weight;
+        if (projected == NULL || (field < colNum && projected[field])) {
+            projectedWeight += weight;
+            projectedCount++;
+        }
+        if (field < colNum)
+            fieldColumnIds[field] = rowType.getSubtype(field).getColumnId();
+    }
+
+    double ratio = 1;
+    if (totalWeight > 0)
+        ratio = projectedWeight / totalWeight;
+    else if (rowType.getSubtypeCount() > 0)
+        ratio = (double) projectedCount / rowType.getSubtypeCount();
+
+    bool haveStatistics = (reader.getNumberOfStripeStatistics() == stripeCount);
+    double readBytes = 0;
+    std::vector<uint64_t> selectedStripes;
+
+    info->selectedRowCount = 0;
+    info->stripesSelected = 0;
+    for (uint64_t stripe = 0; stripe < stripeCount; stripe++) {
+        std::unique_ptr<orc::StripeInformation> stripeInfo = reader.getStripe(stripe);
+
+        if (argument != NULL && haveStatistics) {
+            std::unique_ptr<orc::Statistics> stripeStatistics = reader.getStripeStatistics(stripe);
+
+            if (!searchArgumentMayMatch(*argument, *stripeStatistics, fieldColumnIds))
+                continue;
+        }
+
+        /* without columns, the row counts of the footer are all the scan reads */
+        if (projectedCount > 0)
+            readBytes += stripeInfo->getFooterLength() + stripeInfo->getDataLength() * ratio;
+        info->selectedRowCount += stripeInfo->getNumberOfRows();
+        info->stripesSelected++;
+        selectedStripes.push_back(stripe);
+    }
+
+    info->readBytes = (unsigned long long) readBytes;
+
+    if (stripeFraction != NULL) {
+        if (haveStatistics)
+            estimateStripeFraction(reader, colNum, fieldColumnIds, selectedStripes, stripeFraction);
+        else
+            std::fill(stripeFraction, stripeFraction + colNum, 1.0);
+    }
+}
+
+/**
+ * Read the footer of the file for the planner, no row reader is set up.
+ * @return false if the file can't be read, the scan will report why.
+ */
+bool getOrcFileInfo(const char* filename, unsigned int fdwColNum, const bool *projected,
+                    const OrcPredicate *root, const char *fileTail, size_t fileTailLength,
+                    OrcFileInfo *info, double *stripeFraction) {
+    /* returned through info->fileTail, until the next call */
+    static std::string serializedTail;
+
+    memset(info, 0, sizeof(OrcFileInfo));
+
+    try {
+        orc::ReaderOptions opts;
+
+        if (fileTail != NULL)
+            opts.setSerializedFileTail(std::string(fileTail, fileTailLength));
+
+        std::unique_ptr<orc::Reader> reader = orc::createReader(orc::readLocalFile(std::string(filename)), opts);
+        std::unique_ptr<SearchArgument> argument;
+
+        if (fileTail == NULL) {
+            serializedTail = reader->getSerializedFileTail();
+            info->fileTail = serializedTail.data();
+            info->fileTailLength = serializedTail.size();
+        }
+
+        info->rowCount = reader->getNumberOfRows();
+        info->contentLength = reader->getContentLength();
+        info->stripeCount = reader->getNumberOfStripes();
+
+        if (root != NULL)
+            argument.reset(new SearchArgument(*root));
+        estimateScan(*reader, fdwColNum, projected, argument.get(), info, stripeFraction);
+    }
+    catch (std::exception &e) {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Rows expected to satisfy the comparison among the values described by the
+ * statistics, -1 if they can't tell. The values are taken as uniform between
+ * min and max, and as all distinct for an equality unless the range of an
+ * integer or date column is narrower. Nulls never match.
+ */
+static double matchingValues(const SearchArgument &argument, const orc::ColumnStatistics *statistics) {
+    double minimum = 0;
+    double maximum = 0;
+    double constant = 0;
+    bool discrete = false;
+
+    if (statistics == NULL)
+        return -1;
+    if (!statisticsMayMatch(argument, statistics))
+        return 0;
+
+    switch (argument.kind) {
+        case ORC_VALUE_INT:
+            if (dynamic_cast<const orc::IntegerColumnStatistics *>(statistics) == NULL)
+                return -1;
+            constant = (double) argument.intValue;
+            discrete = true;
+            break;
+        case ORC_VALUE_DOUBLE:
+            if (dynamic_cast<const orc::DoubleColumnStatistics *>(statistics) == NULL ||
+                std::isnan(argument.doubleValue))
+                return -1;
+            constant = argument.doubleValue;
+            break;
+        case ORC_VALUE_DATE:
+            if (dynamic_cast<const orc::DateColumnStatistics *>(statistics) == NULL)
+                return -1;
+            constant = (double) (argument.intValue + (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE));
+            discrete = true;
+            break;
+        case ORC_VALUE_TIMESTAMP:
+            if (dynamic_cast<const orc::TimestampColumnStatistics *>(statistics) == NULL)
+                return -1;
+            /* the statistics are in milliseconds since 1970-01-01 */
+            constant = (argument.intValue +
+                        (double) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY * 1000000) / 1000.0;
+            break;
+        default:
+            /* a string inside the range may match any share of the rows */
+            return -1;
+    }
+
+    if (!numericRange(statistics, &minimum, &maximum))
+        return -1;
+
+    double values = (double) statistics->getNumberOfValues();
+    double width = maximum - minimum + (discrete ? 1 : 0);
+    double fraction = 1;
+
+    if (argument.op == ORC_PREDICATE_EQ) {
+        fraction = 1 / std::max(1.0, discrete ? std::min(values, width) : values);
+    }
+    else if (width > 0) {
+        switch (argument.op) {
+            case ORC_PREDICATE_LT:
+                fraction = (constant - minimum) / width;
+                break;
+            case ORC_PREDICATE_LE:
+                fraction = (constant - minimum + (discrete ? 1 : 0)) / width;
+                break;
+            case ORC_PREDICATE_GT:
+                fraction = (maximum - constant) / width;
+                break;
+            case ORC_PREDICATE_GE:
+                fraction = (maximum - constant + (discrete ? 1 : 0)) / width;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    return values * std::min(1.0, std::max(0.0, fraction));
+}
+
+/**
+ * Estimate the share of the rows satisfying each comparison, see the header.
+ * @return false if the file can't be read.
+ */
+bool estimateOrcSelectivity(const char* filename, const char *fileTail, size_t fileTailLength,
+                            const OrcPredicate *comparisons, unsigned int comparisonCount,
+                            double *selectivity) {
+    try {
+        orc::ReaderOptions opts;
+
+        if (fileTail != NULL)
+            opts.setSerializedFileTail(std::string(fileTail, fileTailLength));
+
+        std::unique_ptr<orc::Reader> reader = orc::createReader(orc::readLocalFile(std::string(filename)), opts);
+        const orc::Type &rowType = reader->getType();
+        uint64_t stripeCount = reader->getNumberOfStripes();
+        double rowCount = (double) reader->getNumberOfRows();
+        std::vector<std::unique_ptr<orc::Statistics> > statistics;
+        std::vector<double> matching(comparisonCount, 0);
+
+        /* per stripe if the file has their statistics, else the file's as a whole */
+        if (reader->getNumberOfStripeStatistics() == stripeCount) {
+            for (uint64_t stripe = 0; stripe < stripeCount; stripe++)
+                statistics.push_back(reader->getStripeStatistics(stripe));
+        }
+        else
+            statistics.push_back(reader->getStatistics());
+
+        for (unsigned int i = 0; i < comparisonCount; i++) {
+            SearchArgument argument(comparisons[i]);
+
+            if (rowCount == 0 || argument.column >= rowType.getSubtypeCount()) {
+                matching[i] = -1;
+                continue;
+            }
+
+            uint64_t columnId = rowType.getSubtype(argument.column).getColumnId();
+
+            for (size_t j = 0; j < statistics.size() && matching[i] >= 0; j++) {
+                double rows = -1;
+
+                if (columnId < statistics[j]->getNumberOfColumns())
+                    rows = matchingValues(argument, statistics[j]->getColumnStatistics((uint32_t) columnId));
+                matching[i] = (rows < 0) ? -1 : matching[i] + rows;
+            }
+        }
+
+        for (unsigned int i = 0; i < comparisonCount; i++)
+            selectivity[i] = (matching[i] < 0) ? -1 : std::min(1.0, matching[i] / rowCount);
+    }
+    catch (std::exception &e) {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Do stripes a and b, in file order, hold ascending, non-overlapping ranges
+ * of the column? Timestamps are kept in milliseconds, ties may hide sub-ms
+ * values out of order.
+ */
+static bool stripesAscend(const orc::ColumnStatistics *a, const orc::ColumnStatistics *b) {
+    const orc::IntegerColumnStatistics *integerA = dynamic_cast<const orc::IntegerColumnStatistics *>(a);
+    const orc::IntegerColumnStatistics *integerB = dynamic_cast<const orc::IntegerColumnStatistics *>(b);
+    const orc::StringColumnStatistics *stringA = dynamic_cast<const orc::StringColumnStatistics *>(a);
+    const orc::StringColumnStatistics *stringB = dynamic_cast<const orc::StringColumnStatistics *>(b);
+    const orc::TimestampColumnStatistics *timestampA = dynamic_cast<const orc::TimestampColumnStatistics *>(a);
+    const orc::TimestampColumnStatistics *timestampB = dynamic_cast<const orc::TimestampColumnStatistics *>(b);
+    double maximumA = 0;
+    double minimumB = 0;
+    double unused = 0;
+
+    /* int64 exactly, doubles lose precision past 2^53 */
+    if (integerA != NULL && integerB != NULL)
+        return integerA->hasMaximum() && integerB->hasMinimum() &&
+               integerA->getMaximum() <= integerB->getMinimum();
+    if (stringA != NULL && stringB != NULL)
+        return stringA->hasMaximum() && stringB->hasMinimum() &&
+               stringA->getMaximum() <= stringB->getMinimum();
+    if (timestampA != NULL && timestampB != NULL)
+        return timestampA->hasMaximum() && timestampB->hasMinimum() &&
+               timestampA->getMaximum() < timestampB->getMinimum();
+
+    return numericRange(a, &unused, &maximumA) && numericRange(b, &minimumB, &unused) && maximumA <= minimumB;
+}
+
+/**
+ * Check from the stripe statistics that the file can be sorted by a column.
+ * @return false if the file can't be read or the stripes don't ascend.
+ */
+bool checkOrcSortOrder(const char* filename, unsigned int column, const char *fileTail, size_t fileTailLength) {
+    try {
+        orc::ReaderOptions opts;
+
+        if (fileTail != NULL)
+            opts.setSerializedFileTail(std::string(fileTail, fileTailLength));
+
+        std::unique_ptr<orc::Reader> reader = orc::createReader(orc::readLocalFile(std::string(filename)), opts);
+        const orc::Type &rowType = reader->getType();
+        uint64_t stripeCount = reader->getNumberOfStripes();
+        std::unique_ptr<orc::Statistics> previous;
+
+        if (column >= rowType.getSubtypeCount() || reader->getNumberOfStripeStatistics() != stripeCount)
+            return false;
+
+        uint32_t columnId = (uint32_t) rowType.getSubtype(column).getColumnId();
+
+        for (uint64_t stripe = 0; stripe < stripeCount; stripe++) {
+            uint64_t stripeRows = reader->getStripe(stripe)->getNumberOfRows();
+
+            if (stripeRows == 0)
+                continue;
+
+            std::unique_ptr<orc::Statistics> statistics = reader->getStripeStatistics(stripe);
+
+            /* nulls sort last, a stripe with any of them can't be followed */
+            if (columnId >= statistics->getNumberOfColumns() ||
+                statistics->getColumnStatistics(columnId)->getNumberOfValues() != stripeRows)
+                return false;
+
+            if (previous && !stripesAscend(previous->getColumnStatistics(columnId),
+                                           statistics->getColumnStatistics(columnId)))
+                return false;
+
+            previous = std::move(statistics);
+        }
+    }
+    catch (std::exception &e) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * tell the scan the stripes ascend by a column, checked by checkOrcSortOrder().
+ * should be used before setOrcSearchArgument(), -1 for none.
+ */
+void setOrcSortOrder(OrcReaderHandle *handle, int column) {
+    if (handle == NULL || handle->reader == NULL)
+        return;
+
+    handle->reader->sortColumn = column;
+}
+
+/**
+ * Plan the aggregates from the statistics, nothing is decoded.
+ * @return false if the file can't be read or can't answer them, see the header.
+ */
+bool estimateOrcAggregates(const char* filename, unsigned int fdwColNum, const OrcPredicate *root,
+                           const char *fileTail, size_t fileTailLength,
+                           const OrcAggregate *aggregates, unsigned int aggregateCount,
+                           OrcAggregateStats *stats) {
+    try {
+        std::unique_ptr<SearchArgument> argument;
+
+        if (root != NULL)
+            argument.reset(new SearchArgument(*root));
+
+        OrcAggregator aggregator(filename, fdwColNum, fileTail, fileTailLength, argument.get(),
+                                 aggregates, aggregateCount);
+
+        if (!aggregator.fits() || !aggregator.correctStatistics())
+            return false;
+        aggregator.plan(stats);
+    }
+    catch (std::exception &e) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Compute the aggregates, should be used in IterateForeignScan() of an aggregate scan.
+ */
+void computeOrcAggregates(const char* filename, unsigned int fdwColNum, const OrcPredicate *root,
+                          const char *fileTail, size_t fileTailLength,
+                          OrcAggregate *aggregates, unsigned int aggregateCount,
+                          OrcAggregateStats *stats) {
+    bool failed = false;
+
+    try {
+        std::unique_ptr<SearchArgument> argument;
+
+        if (root != NULL)
+            argument.reset(new SearchArgument(*root));
+
+        OrcAggregator aggregator(filename, fdwColNum, fileTail, fileTailLength, argument.get(),
+                                 aggregates, aggregateCount);
+
+        /* the planner checked the file, it may have been replaced since */
+        if (!aggregator.fits())
+            throw std::runtime_error("column types of the file don't match the foreign table");
+
+        aggregator.plan(stats);
+        aggregator.decode();
+        aggregator.results(aggregates);
+    }
+    catch (std::exception &e) {
+        saveOrcError(e);
+        failed = true;
+    }
+
+    if (failed)
+        reportOrcError(filename);
+}
+
+/**
+ * Get the counters of the scan so far, all zero if there is no reader.
+ */
+void getOrcScanStats(OrcReaderHandle *handle, OrcScanStats *stats) {
+    memset(stats, 0, sizeof(OrcScanStats));
+
+    if (handle == NULL || handle->reader == NULL)
+        return;
+
+    handle->reader->OrcGetScanStats(stats);
 }
@@ -1,30 +1,315 @@
 #ifndef ORCLIBBRIDGE_H
 #define ORCLIBBRIDGE_H
-#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C"{
 #endif
 
+/* the bridge produces Datums directly, so it needs the backend's types */
+#include "postgres.h"
+
+/*
+ * One orc row batch worth of converted columns, column-major:
+ * values[col][row] and nulls[col][row] for row < rowCount.
+ * The arrays are allocated by the caller with room for fdwMaxRowPerBatch rows.
+ */
+typedef struct OrcBatch
+{
+    unsigned int rowCount;
+    Datum **values;
+    bool **nulls;
+} OrcBatch;
+
+/* comparison or boolean node of a search argument */
+typedef enum OrcPredicateOp
+{
+    ORC_PREDICATE_EQ,
+    ORC_PREDICATE_LT,
+    ORC_PREDICATE_LE,
+    ORC_PREDICATE_GT,
+    ORC_PREDICATE_GE,
+    ORC_PREDICATE_AND,
+    ORC_PREDICATE_OR
+} OrcPredicateOp;
+
+/* the constant of a comparison, in postgres units */
+typedef enum OrcValueKind
+{
+    ORC_VALUE_INT,          /* int2, int4, int8 */
+    ORC_VALUE_DOUBLE,       /* float4, float8 */
+    ORC_VALUE_STRING,       /* text, varchar */
+    ORC_VALUE_DATE,         /* days since 2000-01-01 */
+    ORC_VALUE_TIMESTAMP     /* microseconds since 2000-01-01 */
+} OrcValueKind;
+
+/*
+ * Search argument pushed down to the bridge: comparisons between a column and
+ * a constant, combined by AND/OR. Rows can only match where the statistics
+ * of the file allow it, the executor still checks every returned row.
+ */
+typedef struct OrcPredicate
+{
+    OrcPredicateOp op;
+
+    /* comparisons */
+    unsigned int column;        /* fdw column index */
+    OrcValueKind kind;
+    int64 intValue;             /* ORC_VALUE_INT, DATE and TIMESTAMP */
+    double doubleValue;
+    const char *stringValue;    /* not null terminated */
+    unsigned int stringLength;
+
+    /* AND/OR */
+    struct OrcPredicate *children;
+    unsigned int childCount;
+} OrcPredicate;
+
+/* what the planner learns from the file's footer */
+typedef struct OrcFileInfo
+{
+    unsigned long long rowCount;
+    unsigned long long contentLength;   /* bytes in the file */
+    unsigned long long stripeCount;
+
+    /* estimates for the planned scan */
+    unsigned long long stripesSelected;     /* not ruled out by the search argument */
+    unsigned long long selectedRowCount;    /* rows in those stripes */
+    unsigned long long readBytes;           /* bytes of the projected columns in them */
+
+    /* serialized tail read from the file, NULL if it was passed in */
+    const char *fileTail;
+    size_t fileTailLength;
+} OrcFileInfo;
+
+/* counters of a scan, for EXPLAIN ANALYZE */
+typedef struct OrcScanStats
+{
+    unsigned long long peakMemory;      /* bytes held by the decode buffers */
+    unsigned long long stripeCount;
+    unsigned long long stripesSkipped;  /* pruned by the search argument */
+    unsigned long long rowsFiltered;    /* removed by the batch filters */
+    unsigned long long stripesCached;   /* read from the shared chunk cache */
+    unsigned long long stripesReadAhead;    /* decoded by the worker threads */
+} OrcScanStats;
+
+/* aggregates the bridge answers without returning rows */
+typedef enum OrcAggregateKind
+{
+    ORC_AGGREGATE_COUNT_ROWS,   /* count(*) */
+    ORC_AGGREGATE_COUNT,        /* count(column), the non-null values */
+    ORC_AGGREGATE_MIN,
+    ORC_AGGREGATE_MAX,
+    ORC_AGGREGATE_SUM           /* of an INT column as int8, of a DOUBLE one as float8 */
+} OrcAggregateKind;
+
+/*
+ * One aggregate over the rows satisfying a search argument, without GROUP BY.
+ * The result is in the postgres units of valueKind, as the constants of
+ * OrcPredicate; counts and integer sums are in intValue.
+ */
+typedef struct OrcAggregate
+{
+    OrcAggregateKind kind;
+    unsigned int column;        /* fdw column index, not for COUNT_ROWS */
+    OrcValueKind valueKind;     /* of the column */
+
+    /* result */
+    bool isNull;                /* no value to aggregate, never for counts */
+    int64 intValue;
+    double doubleValue;
+    const char *stringValue;    /* not null terminated, valid until the next call */
+    unsigned int stringLength;
+} OrcAggregate;
+
+/* how the aggregates were answered, for the planner and EXPLAIN ANALYZE */
+typedef struct OrcAggregateStats
+{
+    unsigned long long stripeCount;
+    unsigned long long stripesSkipped;  /* ruled out by the search argument */
+    unsigned long long stripesAnswered; /* from the stripe statistics alone */
+    unsigned long long stripesDecoded;  /* the statistics couldn't tell */
+    unsigned long long rowsDecoded;
+} OrcAggregateStats;
+
+/*
+ * Reader of one scan. Each scan gets its own, so self joins and concurrent
+ * scans of one file don't share state. It is allocated in the scan's decode
+ * context and the reader is released with that context at the latest.
+ */
+typedef struct OrcReaderHandle OrcReaderHandle;
+
 /* wrapper functions for fdw*/
 
-/* init global var, should be used in BeginForeignScan() */
-void initOrcReader(const char* filename, unsigned int fdwColNum, unsigned int fdwMaxRowPerBatch);
+/**
+ * open the file for one scan, should be used in BeginForeignScan()
+ * @param typeIds: atttypid of each fdw column
+ * @param typeMods: atttypmod of each fdw column
+ * @param projected: columns used by the query, only those are read from the
+ *        file, the others are returned as nulls.
+ * @param textFallback: output, set to true for the columns which have no
+ *        binary converter, their values are returned as cstrings and
+ *        must be passed through the column type's input function.
+ * @param batchContext: holds the by-reference values of one batch, it is
+ *        reset by every getOrcNextBatch() call.
+ * @param decodeContext: the orc lib's memory pool allocates from it, it must
+ *        stay alive until releaseOrcReader() and be deleted afterwards.
+ * @param fileTail: serialized tail of the file, from getOrcSerializedTail() or
+ *        getOrcFileInfo() of an unchanged file, or NULL to read it from the file.
+ */
+OrcReaderHandle *initOrcReader(const char* filename, unsigned int fdwColNum, unsigned int fdwMaxRowPerBatch,
+                               const Oid *typeIds, const int32 *typeMods, const bool *projected,
+                               bool *textFallback, MemoryContext batchContext, MemoryContext decodeContext,
+                               const char *fileTail, size_t fileTailLength);
 
 /**
- * iteratively get one line record, , should be used in IterativeForeignScan()
+ * get the serialized tail of the file of the scan, to open it again without
+ * reading the footer. the bytes stay valid until releaseOrcReader().
+ */
+void getOrcSerializedTail(OrcReaderHandle *handle, const char **fileTail, size_t *fileTailLength);
+
+/**
+ * set the search argument of the scan, should be used in BeginForeignScan()
+ * after initOrcReader(), and again before a rescan whose parameters changed.
+ * stripes whose statistics prove that no row satisfies root are skipped. the
+ * tree is copied, root may be NULL.
+ * @param filtered: output, one flag per child of root if root is an AND, else
+ *        one for root. set to true for the comparisons the bridge evaluates
+ *        exactly, rows failing them are never returned.
+ */
+void setOrcSearchArgument(OrcReaderHandle *handle, const OrcPredicate *root, bool *filtered);
+
+/**
+ * read and convert the next row batch, should be used in IterativeForeignScan()
+ * once all rows of the previous batch are returned.
+ * values of the previous batch are released, by-reference values of the new
+ * one are allocated in batchContext.
  * @return: false means no next record.
  */
-bool getOrcNextTuple(const char* filename, char **tuple);
+bool getOrcNextBatch(OrcReaderHandle *handle, OrcBatch *batch);
+
+/**
+ * restart the scan from the first row, should be used in ReScanForeignScan().
+ * the reader, its search argument and its buffers are kept.
+ */
+void rescanOrcReader(OrcReaderHandle *handle);
+
+/**
+ * make the scan return a random sample of about targetRows rows instead of
+ * all of them, in file order, should be used by ANALYZE after initOrcReader().
+ * whole blocks of fdwMaxRowPerBatch rows within one stripe are sampled, spread
+ * uniformly over the stripes, and only they are decoded. the same seed picks
+ * the same blocks. all rows are returned if the file has no more than targetRows.
+ * @return: the number of rows in the file.
+ */
+unsigned long long setOrcSample(OrcReaderHandle *handle, unsigned long long targetRows, unsigned int seed);
+
+/**
+ * decode the scan's stripes ahead of it on threadCount worker threads, 0 for
+ * none, should be used in BeginForeignScan() after initOrcReader(). the
+ * workers read whole stripes with readers of their own and never call into
+ * postgres, the backend only converts. ignored for column types the chunk
+ * cache can't hold, and before postgresql 9.5, which can't stop the threads
+ * of an aborted scan. on 13 and later the workers' file descriptors are
+ * counted against max_files_per_process, fewer workers start if they don't fit.
+ * @param columnGroups: the projected fields are split into up to this many
+ *        groups of about equal size, the groups of one stripe are decoded by
+ *        different workers at once. 1 decodes a stripe on a single worker.
+ *        each worker keeps to one group, so there are no more groups than
+ *        workers.
+ * @param memoryLimit: bytes the decoded stripes waiting for the scan may
+ *        take, past it only the stripe the scan needs next is decoded. each
+ *        worker holds the stripe it decodes on top of that.
+ */
+void setOrcReadAhead(OrcReaderHandle *handle, unsigned int threadCount, unsigned int columnGroups,
+                     size_t memoryLimit);
+
+/*
+ * Returns the next stripe number of a shared cursor, which all participants
+ * of a parallel scan advance. It's called from c++ frames, so it must not
+ * raise errors.
+ */
+typedef unsigned long long (*OrcStripeClaim)(void *argument);
+
+/**
+ * make the scan read only the stripes it claims through claim, one at a time
+ * and in order, so that the participants of a parallel scan split the file
+ * between them. should be used before the first batch, and the cursor reset
+ * before every rescan. stops the read ahead, which can't know the claims.
+ */
+void setOrcStripeClaim(OrcReaderHandle *handle, OrcStripeClaim claim, void *argument);
 
 /* release tuple memory, should be used in EndForeignScan() */
-void releaseOrcReader(const char* filename);
+void releaseOrcReader(OrcReaderHandle *handle);
+
+/**
+ * Read the file's footer, can be used at plan time without initOrcReader().
+ * @param projected: columns the query reads, as in initOrcReader(), NULL for all.
+ * @param root: search argument of the query as in setOrcSearchArgument(), may be NULL.
+ * @param fileTail: serialized tail of the file as in initOrcReader(), may be NULL.
+ * @param stripeFraction: output, may be NULL. one per fdw column, the share of
+ *        the selected stripes an equality on the column is expected to read
+ *        if its value is only known at run time, 1 if the stripes can't tell.
+ * @return false if the file can't be read, info is zeroed then.
+ */
+bool getOrcFileInfo(const char* filename, unsigned int fdwColNum, const bool *projected,
+                    const OrcPredicate *root, const char *fileTail, size_t fileTailLength,
+                    OrcFileInfo *info, double *stripeFraction);
+
+/**
+ * Estimate from the stripe statistics the share of the file's rows satisfying
+ * each comparison, for the planner while the columns have no statistics of
+ * their own. values are taken as uniform between each stripe's min and max.
+ * can be used at plan time without initOrcReader().
+ * @param comparisons: comparisons as in a search argument, no AND/OR.
+ * @param selectivity: output, one per comparison, -1 where the statistics
+ *        can't tell, e.g. for a string within a stripe's range.
+ * @return false if the file can't be read.
+ */
+bool estimateOrcSelectivity(const char* filename, const char *fileTail, size_t fileTailLength,
+                            const OrcPredicate *comparisons, unsigned int comparisonCount,
+                            double *selectivity);
+
+/**
+ * Check that the file is sorted by an fdw column, ascending and without nulls,
+ * from the stripe statistics. only the order of the stripes is checked, rows
+ * within a stripe are trusted to follow the declared order.
+ * @return false if the file can't be read or the stripes' ranges overlap.
+ */
+bool checkOrcSortOrder(const char* filename, unsigned int column, const char *fileTail, size_t fileTailLength);
+
+/**
+ * tell the scan its stripes ascend by an fdw column, -1 for none, so the
+ * comparisons on it select stripes by binary search. should be used before
+ * setOrcSearchArgument(), and only for a column checkOrcSortOrder() accepted.
+ */
+void setOrcSortOrder(OrcReaderHandle *handle, int column);
+
+/**
+ * Plan aggregates over the rows of the file satisfying root, which must only
+ * compare columns whose file type fits the constant. Nothing is decoded, the
+ * stats tell how many stripes and rows computeOrcAggregates() would have to.
+ * @return false if the file can't be read, its statistics are known to be
+ *         wrong, or an aggregated or compared column doesn't fit its file type.
+ */
+bool estimateOrcAggregates(const char* filename, unsigned int fdwColNum, const OrcPredicate *root,
+                           const char *fileTail, size_t fileTailLength,
+                           const OrcAggregate *aggregates, unsigned int aggregateCount,
+                           OrcAggregateStats *stats);
+
+/**
+ * Compute the aggregates, from the statistics of the stripes that all or
+ * none of the rows satisfy root, by decoding the others. The results are set
+ * in aggregates, errors are reported.
+ */
+void computeOrcAggregates(const char* filename, unsigned int fdwColNum, const OrcPredicate *root,
+                          const char *fileTail, size_t fileTailLength,
+                          OrcAggregate *aggregates, unsigned int aggregateCount,
+                          OrcAggregateStats *stats);
 
 /**
- * Get the number of rows in the file.
- * @return the number of rows
+ * Get the counters of the scan so far, all zero if there is no reader.
  */
-unsigned long long getOrcTupleCount(const char* filename);
+void getOrcScanStats(OrcReaderHandle *handle, OrcScanStats *stats);
 
 
 #ifdef __cplusplus
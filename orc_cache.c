@@ -0,0 +1,683 @@
+/*-------------------------------------------------------------------------
+ *
+ * orc_cache.c
+ *		  shared memory caches of orc_fdw.
+ *
+ * The tail cache keeps the serialized postscript, footer and metadata of
+ * recently opened files, so planning and scan startup can skip reading and
+ * parsing them. Its memory is split into fixed size blocks, a tail takes a
+ * run of contiguous blocks, and the least recently used tails are evicted
+ * until a run is free. Everything is protected by one LWLock, which lookups
+ * only take shared.
+ *
+ * The chunk cache keeps the decoded values of one column of one stripe, as
+ * serialized by the bridge, so backends scanning the same hot files don't all
+ * decompress and decode the same stripes. A chunk takes a chain of fixed size
+ * blocks found through a shared hash table, and blocks are reclaimed by a
+ * CLOCK sweep which spares the chunks read since the hand last passed them.
+ * Lookups only take its LWLock shared.
+ *
+ * IDENTIFICATION
+ *		  contrib/orc_fdw/orc_cache.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+
+#include "orc_cache.h"
+
+#define ORC_TAIL_CACHE_BLOCK_SIZE 4096
+#define ORC_CHUNK_CACHE_BLOCK_SIZE 8192
+#define ORC_CACHE_TRANCHE_NAME "orc_fdw"
+
+int orc_tail_cache_size = 8192;
+int orc_stripe_cache_size = 0;
+
+typedef struct OrcTailCacheEntry
+{
+    bool used;
+    char filename[MAXPGPATH];
+    ino_t inode;
+    off_t size;
+    time_t mtime;
+    uint64 lastUsed;
+    int firstBlock;
+    int blockCount;
+    Size length;
+} OrcTailCacheEntry;
+
+typedef struct OrcTailCache
+{
+    LWLock *lock;
+    uint64 clock;               /* advanced by inserts, hits take its current value */
+    int entryCount;
+    int blockCount;
+    /* then entries[entryCount], blockOwner[blockCount] and the blocks */
+    OrcTailCacheEntry entries[FLEXIBLE_ARRAY_MEMBER];
+} OrcTailCache;
+
+static OrcTailCache *tailCache = NULL;
+
+typedef struct OrcChunkEntry
+{
+    OrcChunkKey key;
+    bool referenced;            /* read since the clock hand last passed */
+    int firstBlock;
+    int blockCount;
+    Size length;
+} OrcChunkEntry;
+
+typedef struct OrcChunkCache
+{
+    LWLock *lock;
+    int blockCount;
+    int freeBlock;              /* head of the free list, -1 if empty */
+    int freeCount;
+    int clockHand;
+    /* then blockNext[blockCount], blockOwner[blockCount] and the blocks */
+    int blockNext[FLEXIBLE_ARRAY_MEMBER];
+} OrcChunkCache;
+
+static OrcChunkCache *chunkCache = NULL;
+static HTAB *chunkHash = NULL;
+
+static shmem_startup_hook_type prevShmemStartupHook = NULL;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prevShmemRequestHook = NULL;
+#endif
+
+static void OrcCacheRequestShmem(void);
+static void OrcCacheShmemStartup(void);
+static Size OrcTailCacheShmemSize(void);
+static int *OrcTailCacheBlockOwner(void);
+static char *OrcTailCacheBlock(int block);
+static bool OrcTailCacheEntryMatches(OrcTailCacheEntry *entry, const char *filename,
+                                     const struct stat *statBuffer);
+static void OrcTailCacheEvict(OrcTailCacheEntry *entry);
+static int OrcTailCacheFindBlocks(int blockCount);
+static int OrcChunkCacheBlockCount(void);
+static Size OrcChunkCacheStructSize(void);
+static Size OrcChunkCacheShmemSize(void);
+static OrcChunkEntry **OrcChunkCacheBlockOwner(void);
+static char *OrcChunkCacheBlock(int block);
+static void OrcChunkCacheEvict(OrcChunkEntry *entry);
+static bool OrcChunkCacheReclaim(int blockCount);
+
+void
+OrcCacheInit(void)
+{
+    DefineCustomIntVariable("orc_fdw.tail_cache_size",
+                            "Shared memory for the serialized tails of orc files.",
+                            "Needs orc_fdw in shared_preload_libraries, 0 disables the cache.",
+                            &orc_tail_cache_size,
+                            8192,
+                            0,
+                            INT_MAX / 1024,
+                            PGC_POSTMASTER,
+                            GUC_UNIT_KB,
+                            NULL,
+                            NULL,
+                            NULL);
+
+    DefineCustomIntVariable("orc_fdw.stripe_cache_size",
+                            "Shared memory for the decoded column chunks of orc stripes.",
+                            "Needs orc_fdw in shared_preload_libraries, 0 disables the cache.",
+                            &orc_stripe_cache_size,
+                            0,
+                            0,
+                            INT_MAX / 1024,
+                            PGC_POSTMASTER,
+                            GUC_UNIT_KB,
+                            NULL,
+                            NULL,
+                            NULL);
+
+    if (!process_shared_preload_libraries_in_progress)
+    {
+        return;
+    }
+
+#if PG_VERSION_NUM >= 150000
+    prevShmemRequestHook = shmem_request_hook;
+    shmem_request_hook = OrcCacheRequestShmem;
+#else
+    OrcCacheRequestShmem();
+#endif
+
+    prevShmemStartupHook = shmem_startup_hook;
+    shmem_startup_hook = OrcCacheShmemStartup;
+}
+
+static void
+OrcCacheRequestShmem(void)
+{
+#if PG_VERSION_NUM >= 150000
+    if (prevShmemRequestHook)
+    {
+        prevShmemRequestHook();
+    }
+#endif
+
+    RequestAddinShmemSpace(OrcTailCacheShmemSize());
+    RequestAddinShmemSpace(OrcChunkCacheShmemSize());
+#if PG_VERSION_NUM >= 90600
+    RequestNamedLWLockTranche(ORC_CACHE_TRANCHE_NAME, 2);
+#else
+    RequestAddinLWLocks(2);
+#endif
+}
+
+static Size
+OrcTailCacheShmemSize(void)
+{
+    Size blockCount = ((Size) orc_tail_cache_size * 1024) / ORC_TAIL_CACHE_BLOCK_SIZE;
+    Size entryCount = blockCount / 2 + 1;
+    Size size = offsetof(OrcTailCache, entries);
+
+    size = add_size(size, mul_size(entryCount, sizeof(OrcTailCacheEntry)));
+    size = add_size(size, mul_size(blockCount, sizeof(int)));
+    size = MAXALIGN(size);
+    size = add_size(size, mul_size(blockCount, ORC_TAIL_CACHE_BLOCK_SIZE));
+
+    return size;
+}
+
+static int
+OrcChunkCacheBlockCount(void)
+{
+    return (int) (((Size) orc_stripe_cache_size * 1024) / ORC_CHUNK_CACHE_BLOCK_SIZE);
+}
+
+static Size
+OrcChunkCacheStructSize(void)
+{
+    Size blockCount = OrcChunkCacheBlockCount();
+    Size size = offsetof(OrcChunkCache, blockNext);
+
+    size = add_size(size, mul_size(blockCount, sizeof(int)));
+    size = add_size(size, mul_size(blockCount, sizeof(OrcChunkEntry *)));
+    size = MAXALIGN(size);
+    size = add_size(size, mul_size(blockCount, ORC_CHUNK_CACHE_BLOCK_SIZE));
+
+    return size;
+}
+
+static Size
+OrcChunkCacheShmemSize(void)
+{
+    if (OrcChunkCacheBlockCount() == 0)
+    {
+        return 0;
+    }
+
+    /* every chunk owns a block at least, so the table never outgrows blockCount */
+    return add_size(OrcChunkCacheStructSize(),
+                    hash_estimate_size(OrcChunkCacheBlockCount(), sizeof(OrcChunkEntry)));
+}
+
+static void
+OrcCacheShmemStartup(void)
+{
+    bool found = false;
+    int block = 0;
+#if PG_VERSION_NUM >= 90600
+    LWLockPadded *locks = NULL;
+#endif
+
+    if (prevShmemStartupHook)
+    {
+        prevShmemStartupHook();
+    }
+
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+#if PG_VERSION_NUM >= 90600
+    locks = GetNamedLWLockTranche(ORC_CACHE_TRANCHE_NAME);
+#endif
+
+    if (OrcChunkCacheBlockCount() > 0)
+    {
+        HASHCTL info;
+
+        chunkCache = (OrcChunkCache *) ShmemInitStruct("orc_fdw chunk cache", OrcChunkCacheStructSize(), &found);
+        if (!found)
+        {
+            chunkCache->blockCount = OrcChunkCacheBlockCount();
+            chunkCache->freeBlock = 0;
+            chunkCache->freeCount = chunkCache->blockCount;
+            chunkCache->clockHand = 0;
+#if PG_VERSION_NUM >= 90600
+            chunkCache->lock = &locks[1].lock;
+#else
+            chunkCache->lock = LWLockAssign();
+#endif
+
+            for (block = 0; block < chunkCache->blockCount; block++)
+            {
+                chunkCache->blockNext[block] = (block + 1 < chunkCache->blockCount) ? block + 1 : -1;
+                OrcChunkCacheBlockOwner()[block] = NULL;
+            }
+        }
+
+        memset(&info, 0, sizeof(info));
+        info.keysize = sizeof(OrcChunkKey);
+        info.entrysize = sizeof(OrcChunkEntry);
+#if PG_VERSION_NUM >= 90500
+        chunkHash = ShmemInitHash("orc_fdw chunk hash", OrcChunkCacheBlockCount(), OrcChunkCacheBlockCount(),
+                                  &info, HASH_ELEM | HASH_BLOBS);
+#else
+        info.hash = tag_hash;
+        chunkHash = ShmemInitHash("orc_fdw chunk hash", OrcChunkCacheBlockCount(), OrcChunkCacheBlockCount(),
+                                  &info, HASH_ELEM | HASH_FUNCTION);
+#endif
+    }
+
+    if (orc_tail_cache_size < ORC_TAIL_CACHE_BLOCK_SIZE / 1024)
+    {
+        LWLockRelease(AddinShmemInitLock);
+        return;
+    }
+
+    tailCache = (OrcTailCache *) ShmemInitStruct("orc_fdw tail cache", OrcTailCacheShmemSize(), &found);
+    if (!found)
+    {
+        tailCache->blockCount = ((Size) orc_tail_cache_size * 1024) / ORC_TAIL_CACHE_BLOCK_SIZE;
+        tailCache->entryCount = tailCache->blockCount / 2 + 1;
+        tailCache->clock = 0;
+#if PG_VERSION_NUM >= 90600
+        tailCache->lock = &locks[0].lock;
+#else
+        tailCache->lock = LWLockAssign();
+#endif
+        memset(tailCache->entries, 0, tailCache->entryCount * sizeof(OrcTailCacheEntry));
+
+        for (block = 0; block < tailCache->blockCount; block++)
+        {
+            OrcTailCacheBlockOwner()[block] = -1;
+        }
+    }
+
+    LWLockRelease(AddinShmemInitLock);
+}
+
+static int *
+OrcTailCacheBlockOwner(void)
+{
+    return (int *) &tailCache->entries[tailCache->entryCount];
+}
+
+static char *
+OrcTailCacheBlock(int block)
+{
+    char *blocks = (char *) MAXALIGN(OrcTailCacheBlockOwner() + tailCache->blockCount);
+
+    return blocks + (Size) block * ORC_TAIL_CACHE_BLOCK_SIZE;
+}
+
+static bool
+OrcTailCacheEntryMatches(OrcTailCacheEntry *entry, const char *filename, const struct stat *statBuffer)
+{
+    return entry->used && entry->inode == statBuffer->st_ino && entry->size == statBuffer->st_size &&
+           entry->mtime == statBuffer->st_mtime && strcmp(entry->filename, filename) == 0;
+}
+
+static void
+OrcTailCacheEvict(OrcTailCacheEntry *entry)
+{
+    int *blockOwner = OrcTailCacheBlockOwner();
+    int block = 0;
+
+    for (block = entry->firstBlock; block < entry->firstBlock + entry->blockCount; block++)
+    {
+        blockOwner[block] = -1;
+    }
+
+    entry->used = false;
+}
+
+/* first run of blockCount free blocks, or -1 */
+static int
+OrcTailCacheFindBlocks(int blockCount)
+{
+    int *blockOwner = OrcTailCacheBlockOwner();
+    int runStart = 0;
+    int block = 0;
+
+    for (block = 0; block < tailCache->blockCount; block++)
+    {
+        if (blockOwner[block] != -1)
+        {
+            runStart = block + 1;
+        }
+        else if (block - runStart + 1 == blockCount)
+        {
+            return runStart;
+        }
+    }
+
+    return -1;
+}
+
+char *
+OrcTailCacheLookup(const char *filename, const struct stat *statBuffer, Size *length)
+{
+    char *tail = NULL;
+    int entryIndex = 0;
+
+    if (tailCache == NULL)
+    {
+        return NULL;
+    }
+
+    LWLockAcquire(tailCache->lock, LW_SHARED);
+
+    for (entryIndex = 0; entryIndex < tailCache->entryCount; entryIndex++)
+    {
+        OrcTailCacheEntry *entry = &tailCache->entries[entryIndex];
+
+        if (OrcTailCacheEntryMatches(entry, filename, statBuffer))
+        {
+            /*
+             * racing readers all store the same value, the clock only moves
+             * exclusively. the tails hit since the last insert tie as the
+             * most recently used ones.
+             */
+            entry->lastUsed = tailCache->clock;
+            *length = entry->length;
+            tail = (char *) palloc(entry->length);
+            memcpy(tail, OrcTailCacheBlock(entry->firstBlock), entry->length);
+            break;
+        }
+    }
+
+    LWLockRelease(tailCache->lock);
+
+    return tail;
+}
+
+void
+OrcTailCacheInsert(const char *filename, const struct stat *statBuffer, const char *tail, Size length)
+{
+    int blockCount = 0;
+    int firstBlock = -1;
+    OrcTailCacheEntry *freeEntry = NULL;
+    int entryIndex = 0;
+    int block = 0;
+
+    if (tailCache == NULL || length == 0 || strlen(filename) >= MAXPGPATH)
+    {
+        return;
+    }
+
+    blockCount = (int) ((length + ORC_TAIL_CACHE_BLOCK_SIZE - 1) / ORC_TAIL_CACHE_BLOCK_SIZE);
+    if (blockCount > tailCache->blockCount)
+    {
+        return;
+    }
+
+    LWLockAcquire(tailCache->lock, LW_EXCLUSIVE);
+
+    for (entryIndex = 0; entryIndex < tailCache->entryCount; entryIndex++)
+    {
+        OrcTailCacheEntry *entry = &tailCache->entries[entryIndex];
+
+        if (!entry->used)
+        {
+            continue;
+        }
+
+        /* another backend got there first */
+        if (OrcTailCacheEntryMatches(entry, filename, statBuffer))
+        {
+            entry->lastUsed = ++tailCache->clock;
+            LWLockRelease(tailCache->lock);
+            return;
+        }
+
+        /* the file was replaced or rewritten since */
+        if (strcmp(entry->filename, filename) == 0)
+        {
+            OrcTailCacheEvict(entry);
+        }
+    }
+
+    /* evict the least recently used tails until there is an entry and a run of blocks */
+    for (;;)
+    {
+        OrcTailCacheEntry *oldestEntry = NULL;
+
+        freeEntry = NULL;
+        for (entryIndex = 0; entryIndex < tailCache->entryCount; entryIndex++)
+        {
+            OrcTailCacheEntry *entry = &tailCache->entries[entryIndex];
+
+            if (!entry->used)
+            {
+                freeEntry = (freeEntry != NULL) ? freeEntry : entry;
+            }
+            else if (oldestEntry == NULL || entry->lastUsed < oldestEntry->lastUsed)
+            {
+                oldestEntry = entry;
+            }
+        }
+
+        firstBlock = OrcTailCacheFindBlocks(blockCount);
+        if ((freeEntry != NULL && firstBlock >= 0) || oldestEntry == NULL)
+        {
+            break;
+        }
+
+        OrcTailCacheEvict(oldestEntry);
+    }
+
+    if (freeEntry != NULL && firstBlock >= 0)
+    {
+        int *blockOwner = OrcTailCacheBlockOwner();
+
+        strlcpy(freeEntry->filename, filename, MAXPGPATH);
+        freeEntry->inode = statBuffer->st_ino;
+        freeEntry->size = statBuffer->st_size;
+        freeEntry->mtime = statBuffer->st_mtime;
+        freeEntry->lastUsed = ++tailCache->clock;
+        freeEntry->firstBlock = firstBlock;
+        freeEntry->blockCount = blockCount;
+        freeEntry->length = length;
+        freeEntry->used = true;
+
+        for (block = firstBlock; block < firstBlock + blockCount; block++)
+        {
+            blockOwner[block] = (int) (freeEntry - tailCache->entries);
+        }
+        memcpy(OrcTailCacheBlock(firstBlock), tail, length);
+    }
+
+    LWLockRelease(tailCache->lock);
+}
+
+static OrcChunkEntry **
+OrcChunkCacheBlockOwner(void)
+{
+    return (OrcChunkEntry **) &chunkCache->blockNext[chunkCache->blockCount];
+}
+
+static char *
+OrcChunkCacheBlock(int block)
+{
+    char *blocks = (char *) MAXALIGN(OrcChunkCacheBlockOwner() + chunkCache->blockCount);
+
+    return blocks + (Size) block * ORC_CHUNK_CACHE_BLOCK_SIZE;
+}
+
+/* put the chunk's blocks back on the free list and forget it */
+static void
+OrcChunkCacheEvict(OrcChunkEntry *entry)
+{
+    OrcChunkEntry **blockOwner = OrcChunkCacheBlockOwner();
+    int block = entry->firstBlock;
+
+    while (block != -1)
+    {
+        int next = chunkCache->blockNext[block];
+
+        blockOwner[block] = NULL;
+        chunkCache->blockNext[block] = chunkCache->freeBlock;
+        chunkCache->freeBlock = block;
+        chunkCache->freeCount++;
+        block = next;
+    }
+
+    hash_search(chunkHash, &entry->key, HASH_REMOVE, NULL);
+}
+
+/*
+ * Run the clock hand until blockCount blocks are free. A chunk is looked at
+ * when the hand passes its first block: it is evicted unless it was read
+ * since the last pass, so two turns free everything.
+ */
+static bool
+OrcChunkCacheReclaim(int blockCount)
+{
+    OrcChunkEntry **blockOwner = OrcChunkCacheBlockOwner();
+    int step = 0;
+
+    for (step = 0; chunkCache->freeCount < blockCount && step < 2 * chunkCache->blockCount; step++)
+    {
+        int hand = chunkCache->clockHand;
+        OrcChunkEntry *entry = blockOwner[hand];
+
+        if (entry != NULL && entry->firstBlock == hand)
+        {
+            if (entry->referenced)
+            {
+                entry->referenced = false;
+            }
+            else
+            {
+                OrcChunkCacheEvict(entry);
+            }
+        }
+
+        chunkCache->clockHand = (hand + 1) % chunkCache->blockCount;
+    }
+
+    return chunkCache->freeCount >= blockCount;
+}
+
+Size
+OrcChunkCacheMaxLength(void)
+{
+    if (chunkCache == NULL)
+    {
+        return 0;
+    }
+
+    /* one chunk can't flush more than a quarter of the cache */
+    return (Size) chunkCache->blockCount * ORC_CHUNK_CACHE_BLOCK_SIZE / 4;
+}
+
+bool
+OrcChunkCacheLookup(const OrcChunkKey *key, char *buffer, Size bufferSize, Size *length)
+{
+    OrcChunkEntry *entry = NULL;
+
+    if (chunkCache == NULL)
+    {
+        return false;
+    }
+
+    LWLockAcquire(chunkCache->lock, LW_SHARED);
+
+    entry = (OrcChunkEntry *) hash_search(chunkHash, key, HASH_FIND, NULL);
+    if (entry != NULL)
+    {
+        Size copied = 0;
+        int block = entry->firstBlock;
+
+        /* racing readers all store true, the hand only clears it exclusively */
+        entry->referenced = true;
+        *length = entry->length;
+
+        while (entry->length <= bufferSize && copied < entry->length)
+        {
+            Size blockLength = Min(entry->length - copied, ORC_CHUNK_CACHE_BLOCK_SIZE);
+
+            memcpy(buffer + copied, OrcChunkCacheBlock(block), blockLength);
+            copied += blockLength;
+            block = chunkCache->blockNext[block];
+        }
+    }
+
+    LWLockRelease(chunkCache->lock);
+
+    return entry != NULL;
+}
+
+void
+OrcChunkCacheInsert(const OrcChunkKey *key, const char *chunk, Size length)
+{
+    OrcChunkEntry **blockOwner = NULL;
+    OrcChunkEntry *entry = NULL;
+    bool found = false;
+    int blockCount = 0;
+    int previous = -1;
+    Size copied = 0;
+
+    if (chunkCache == NULL || length == 0 || length > OrcChunkCacheMaxLength())
+    {
+        return;
+    }
+
+    blockCount = (int) ((length + ORC_CHUNK_CACHE_BLOCK_SIZE - 1) / ORC_CHUNK_CACHE_BLOCK_SIZE);
+    blockOwner = OrcChunkCacheBlockOwner();
+
+    LWLockAcquire(chunkCache->lock, LW_EXCLUSIVE);
+
+    /* another backend got there first */
+    if (hash_search(chunkHash, key, HASH_FIND, NULL) != NULL || !OrcChunkCacheReclaim(blockCount))
+    {
+        LWLockRelease(chunkCache->lock);
+        return;
+    }
+
+    entry = (OrcChunkEntry *) hash_search(chunkHash, key, HASH_ENTER_NULL, &found);
+    if (entry == NULL)
+    {
+        LWLockRelease(chunkCache->lock);
+        return;
+    }
+
+    /* spared by the next pass of the hand, like a chunk just read */
+    entry->referenced = true;
+    entry->blockCount = blockCount;
+    entry->length = length;
+    entry->firstBlock = chunkCache->freeBlock;
+
+    while (copied < length)
+    {
+        int block = chunkCache->freeBlock;
+        Size blockLength = Min(length - copied, ORC_CHUNK_CACHE_BLOCK_SIZE);
+
+        chunkCache->freeBlock = chunkCache->blockNext[block];
+        chunkCache->freeCount--;
+
+        if (previous != -1)
+        {
+            chunkCache->blockNext[previous] = block;
+        }
+        chunkCache->blockNext[block] = -1;
+        blockOwner[block] = entry;
+
+        memcpy(OrcChunkCacheBlock(block), chunk + copied, blockLength);
+        copied += blockLength;
+        previous = block;
+    }
+
+    LWLockRelease(chunkCache->lock);
+}
@@ -0,0 +1,69 @@
+/*-------------------------------------------------------------------------
+ *
+ * orc_cache.h
+ *		  shared memory caches of orc_fdw.
+ *
+ * IDENTIFICATION
+ *		  contrib/orc_fdw/orc_cache.h
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef ORC_CACHE_H
+#define ORC_CACHE_H
+
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* GUC, kB of shared memory for serialized file tails */
+extern int orc_tail_cache_size;
+
+/* GUC, kB of shared memory for decoded column chunks, 0 by default */
+extern int orc_stripe_cache_size;
+
+/* defines the GUCs and requests the shared memory, called from _PG_init() */
+extern void OrcCacheInit(void);
+
+/*
+ * Serialized file tails, keyed by path, inode, size and mtime so a replaced
+ * or rewritten file is never served a stale tail. Lookups return a palloc'd
+ * copy, or NULL on a miss or when the cache isn't set up, i.e. orc_fdw is
+ * not in shared_preload_libraries.
+ */
+extern char *OrcTailCacheLookup(const char *filename, const struct stat *statBuffer, Size *length);
+extern void OrcTailCacheInsert(const char *filename, const struct stat *statBuffer,
+                               const char *tail, Size length);
+
+/*
+ * Decoded values of one column of one stripe, in the bridge's format. A file
+ * is told apart by device and inode, and its chunks are left to age out once
+ * its size or mtime changes. The key is hashed as raw bytes, zero it first.
+ */
+typedef struct OrcChunkKey
+{
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    time_t mtime;
+    uint32 stripe;
+    uint32 column;              /* orc column id */
+} OrcChunkKey;
+
+/* longest chunk the cache takes, 0 when it isn't set up */
+extern Size OrcChunkCacheMaxLength(void);
+
+/*
+ * false on a miss. On a hit *length is set, and the chunk is copied into
+ * buffer if it fits, so the caller retries with a larger buffer otherwise.
+ * Neither function raises errors, the bridge calls them from c++ frames.
+ */
+extern bool OrcChunkCacheLookup(const OrcChunkKey *key, char *buffer, Size bufferSize, Size *length);
+extern void OrcChunkCacheInsert(const OrcChunkKey *key, const char *chunk, Size length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ORC_CACHE_H
@@ -12,36 +12,87 @@
  */
 #include "postgres.h"
 
+#include <math.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include "access/htup_details.h"
+#include "access/nbtree.h"
 #include "access/reloptions.h"
 #include "access/sysattr.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_am.h"
 #include "catalog/pg_foreign_table.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_type.h"
 #include "commands/defrem.h"
 #include "commands/explain.h"
 #include "commands/vacuum.h"
+#include "executor/executor.h"
 #include "foreign/fdwapi.h"
 #include "foreign/foreign.h"
 #include "miscadmin.h"
 #include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
 #include "optimizer/planmain.h"
 #include "optimizer/restrictinfo.h"
+#if PG_VERSION_NUM >= 120000
+#include "access/table.h"
+#include "optimizer/optimizer.h"
+#else
 #include "optimizer/var.h"
+#endif
 #include "utils/memutils.h"
 #include "utils/rel.h"
+#include "utils/syscache.h"
 #include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/guc.h"
+#include "utils/datum.h"
 #include "utils/lsyscache.h"
+#include "utils/pg_locale.h"
+#include "utils/timestamp.h"
+#include "utils/typcache.h"
+#if PG_VERSION_NUM >= 90500
+#include "utils/sampling.h"
+#endif
+#if PG_VERSION_NUM >= 90600
+#include "access/parallel.h"
+#include "storage/shm_toc.h"
+#endif
+#if PG_VERSION_NUM >= 100000
+#include "utils/varlena.h"
+#endif
 
 #include "storage/fd.h"
+#include "orc_cache.h"
 #include "orc_fdw.h"
 #include "orcLibBridge.h"
 
 PG_MODULE_MAGIC;
 
+/* the names of the newer releases, on the older ones */
+#if PG_VERSION_NUM < 120000
+#define table_open(relationId, lockmode) heap_open(relationId, lockmode)
+#define table_close(relation, lockmode) heap_close(relation, lockmode)
+#endif
+#ifndef TupleDescAttr
+#define TupleDescAttr(tupleDescriptor, i) ((tupleDescriptor)->attrs[(i)])
+#endif
+#if PG_VERSION_NUM >= 110000
+#define ExplainPropertyLong(qlabel, value, es) ExplainPropertyInteger(qlabel, NULL, value, es)
+#endif
+
+void _PG_init(void);
+
+/* GUCs, threads decoding stripes ahead of each scan, and how many of them share a stripe */
+static int orc_decode_threads = 0;
+static int orc_decode_column_groups = 1;
+
 //cjq
 //FILE * logfile;
 
@@ -74,6 +125,9 @@ static void fileEndForeignScan(ForeignScanState *node);
 static bool fileAnalyzeForeignTable(Relation relation,
                                     AcquireSampleRowsFunc *func,
                                     BlockNumber *totalpages);
+static int OrcAcquireSampleRows(Relation relation, int elevel,
+                                HeapTuple *rows, int targrows,
+                                double *totalrows, double *totaldeadrows);
 
 /*
  * Helper functions
@@ -81,13 +135,142 @@ static bool fileAnalyzeForeignTable(Relation relation,
 
 static OrcFdwOptions * OrcGetOptions(Oid foreignTableId);
 
+static void OrcEstimateSize(RelOptInfo *baserel, Oid foreignTableId, OrcPlanState *planState);
+
+static void OrcFooterSelectivity(RelOptInfo *baserel, Oid foreignTableId, OrcPlanState *planState);
+
+static List *OrcSortColumnList(Oid foreignTableId, OrcPlanState *planState,
+                               const char *fileTail, Size fileTailLength);
+
+static List *OrcSortPathKeys(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId);
+
+static void OrcScanCost(RelOptInfo *baserel, Oid foreignTableId, double stripeFraction,
+                        Cost *startupCost, Cost *totalCost);
+
+static void OrcAddParameterizedPaths(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId,
+                                     List *pathKeys);
+
+static bool OrcEclassMemberMatches(PlannerInfo *root, RelOptInfo *baserel, EquivalenceClass *eclass,
+                                   EquivalenceMember *member, void *arg);
+
+static bool OrcParameterClause(RestrictInfo *restrictInfo, RelOptInfo *baserel, Var **column,
+                               Expr **parameter);
+
+static Const *OrcInt8Const(int64 value);
+
+static Const *OrcFileTailConst(OrcPlanState *planState);
+
+static char *OrcPlanFileTail(List *foreignPrivateList, const struct stat *statBuffer, Size *length);
+
 static char * OrcGetOptionValue(Oid foreignTableId, const char *optionName);
 
 static List *ColumnList(RelOptInfo *baserel, Oid foreignTableId);
 
+static void OrcConvertTextColumns(OrcExeState *orcState);
+
+static bool OrcNextBatch(OrcExeState *orcState);
+
+static void OrcKeepBatch(OrcExeState *orcState);
+
+static void OrcDropKeptBatches(OrcExeState *orcState);
+
+static List *OrcSearchArgumentList(List *restrictInfoList, Index relid);
+
+static int OrcListPosition(List *list, void *pointer);
+
+static bool OrcFilterableClause(Expr *clause, Index relid);
+
+static Expr *OrcSearchArgumentClause(Expr *clause, Index relid);
+
+static bool OrcComparisonOperands(OpExpr *opExpr, Index relid, Var **column,
+                                  Const **constant, OrcPredicateOp *predicateOp);
+
+static bool OrcValueKindOf(Oid typeId, OrcValueKind *valueKind);
+
+static OrcPredicate *OrcBuildSearchArgument(List *clauseList, Index relid,
+                                            OrcPredicate *parameters, int parameterCount);
+
+static void OrcBuildPredicate(Expr *clause, Index relid, OrcPredicate *predicate);
+
+static void OrcSetPredicateValue(OrcPredicate *predicate, Oid typeId, Datum value);
+
+static void OrcApplyParameters(ForeignScanState *node);
+
+static Path *OrcCreateScanPath(PlannerInfo *root, RelOptInfo *baserel, double rows, Cost startupCost,
+                               Cost totalCost, List *pathKeys, Relids requiredOuter);
+
+#if PG_VERSION_NUM >= 90600
+#if PG_VERSION_NUM >= 110000
+static void fileGetForeignUpperPaths(PlannerInfo *root, UpperRelationKind stage, RelOptInfo *inputRel,
+                                     RelOptInfo *outputRel, void *extra);
+#else
+static void fileGetForeignUpperPaths(PlannerInfo *root, UpperRelationKind stage, RelOptInfo *inputRel,
+                                     RelOptInfo *outputRel);
+#endif
+
+static bool OrcAggregateTarget(Expr *expr, Index relid, List **aggregateList);
+
+static bool fileIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte);
+static Size fileEstimateDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt);
+static void fileInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt, void *coordinate);
+#if PG_VERSION_NUM >= 100000
+static void fileReInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt, void *coordinate);
+#endif
+static void fileInitializeWorkerForeignScan(ForeignScanState *node, shm_toc *toc, void *coordinate);
+
+static void OrcAddPartialPath(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId, List *pathKeys);
+
+static unsigned long long OrcClaimStripe(void *argument);
+
+static ForeignScan *OrcAggregatePlan(RelOptInfo *upperRel, ForeignPath *bestPath, List *tlist);
+#endif
+
+static OrcAggregate *OrcAggregateArray(List *aggregateList);
+
+static void OrcBeginAggregateScan(ForeignScanState *node, OrcExeState *orcState);
+
+static TupleTableSlot *OrcIterateAggregates(ForeignScanState *node);
+
+static Datum OrcAggregateDatum(OrcAggregate *aggregate, Oid resultType, bool *isNull);
+
 //static List * ColumnList(RelOptInfo *baserel);
 
-static TupleTableSlot *simIterateForeignScan(ForeignScanState *node);
+/*
+ * Module load callback, sets up the shared memory caches when loaded through
+ * shared_preload_libraries.
+ */
+void
+_PG_init(void)
+{
+    OrcCacheInit();
+
+    /* the threads' memory and files are outside postgres' accounting, so only superusers set them */
+    DefineCustomIntVariable("orc_fdw.decode_threads",
+                            "Worker threads decoding the stripes of a scan ahead of it.",
+                            "The decoded stripes waiting for the scan are held to work_mem, 0 disables it.",
+                            &orc_decode_threads,
+                            0,
+                            0,
+                            64,
+                            PGC_SUSET,
+                            0,
+                            NULL,
+                            NULL,
+                            NULL);
+
+    DefineCustomIntVariable("orc_fdw.decode_column_groups",
+                            "Groups of columns each stripe is split into for the decode threads.",
+                            "The groups of one stripe are decoded by different threads at once, there are no more groups than threads.",
+                            &orc_decode_column_groups,
+                            1,
+                            1,
+                            64,
+                            PGC_SUSET,
+                            0,
+                            NULL,
+                            NULL,
+                            NULL);
+}
 
 /*
  * Foreign-data wrapper handler function: return a struct with pointers
@@ -104,12 +287,23 @@ orc_fdw_handler(PG_FUNCTION_ARGS)
     fdwroutine->ExplainForeignScan = fileExplainForeignScan;
     fdwroutine->BeginForeignScan = fileBeginForeignScan;
     fdwroutine->IterateForeignScan = fileIterateForeignScan;
-    //simIterateForeignScan is just for testing.
-    //fdwroutine->IterateForeignScan = simIterateForeignScan;
     fdwroutine->ReScanForeignScan = fileReScanForeignScan;
     fdwroutine->EndForeignScan = fileEndForeignScan;
-    // only for ANALYZE foreign table, now we don't implement it
+    /* a sample of blocks spread over the stripes */
     fdwroutine->AnalyzeForeignTable = fileAnalyzeForeignTable;
+#if PG_VERSION_NUM >= 90600
+    /* count(*), min(), max() and sum() from the file's statistics */
+    fdwroutine->GetForeignUpperPaths = fileGetForeignUpperPaths;
+
+    /* parallel scans, the participants claim stripes from a cursor in shared memory */
+    fdwroutine->IsForeignScanParallelSafe = fileIsForeignScanParallelSafe;
+    fdwroutine->EstimateDSMForeignScan = fileEstimateDSMForeignScan;
+    fdwroutine->InitializeDSMForeignScan = fileInitializeDSMForeignScan;
+#if PG_VERSION_NUM >= 100000
+    fdwroutine->ReInitializeDSMForeignScan = fileReInitializeDSMForeignScan;
+#endif
+    fdwroutine->InitializeWorkerForeignScan = fileInitializeWorkerForeignScan;
+#endif
 
     PG_RETURN_POINTER(fdwroutine);
 }
@@ -160,6 +354,21 @@ orc_fdw_validator(PG_FUNCTION_ARGS)
         {
             filenameFound = true;
         }
+
+        /* the columns are looked up at plan time, they may be renamed */
+        if (strncmp(optionName, OPTION_NAME_SORTED_BY, NAMEDATALEN) == 0)
+        {
+            List *columnNameList = NIL;
+
+            if (!SplitIdentifierString(pstrdup(defGetString(optionDef)), ',', &columnNameList) ||
+                columnNameList == NIL)
+            {
+                ereport(ERROR,
+                        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                                errmsg("invalid value for option \"%s\"", OPTION_NAME_SORTED_BY),
+                                errhint("Give a comma-separated list of column names.")));
+            }
+        }
     }
 
     if (optionContextId == ForeignTableRelationId)
@@ -225,6 +434,7 @@ OrcGetOptions(Oid foreignTableId)
 
     orcFdwOptions = (OrcFdwOptions *) palloc0(sizeof(OrcFdwOptions));
     orcFdwOptions->filename = filename;
+    orcFdwOptions->sortedBy = OrcGetOptionValue(foreignTableId, OPTION_NAME_SORTED_BY);
 
     return orcFdwOptions;
 }
@@ -238,489 +448,2623 @@ fileGetForeignRelSize(PlannerInfo *root,
                       RelOptInfo *baserel,
                       Oid foreigntableid)
 {
-    OrcFdwOptions *options = OrcGetOptions(foreigntableid);
-    /* OrcFdwOptions is stored as baserel->fdw_private for future use
-     * OrcFdwOptions *options = (OrcFdwOptions *) node->fdw_private; */
-    baserel->fdw_private = (void *) options;
+    OrcPlanState *planState = (OrcPlanState *) palloc0(sizeof(OrcPlanState));
+
+    /* OrcPlanState is stored as baserel->fdw_private for GetForeignPaths and GetForeignPlan */
+    planState->options = OrcGetOptions(foreigntableid);
+    baserel->fdw_private = (void *) planState;
 
     /* Estimate relation size */
-    /*actualTotalRowCount is stored as global var, avoid repeat computing
-     * can't be stored in OrcFdwOptions: because only can be used if baserel is provided*/
-    //actualTotalRowCount = getOrcTupleCount(options->filename);
-    //double tupleCount = (double) actualTotalRowCount;
-    double tupleCount = getOrcTupleCount(options->filename);
+    OrcEstimateSize(baserel, foreigntableid, planState);
+    OrcFooterSelectivity(baserel, foreigntableid, planState);
 
     double rowSelectivity = clauselist_selectivity(root, baserel->baserestrictinfo, 0, JOIN_INNER,
                                                    NULL);
 
-    double outputRowCount = clamp_row_est(tupleCount * rowSelectivity);
+    double outputRowCount = clamp_row_est(planState->tupleCount * rowSelectivity);
     baserel->rows = outputRowCount;
 }
 
 /*
- * fileGetForeignPaths
- *		Create possible access paths for a scan on the foreign table
- *
- *		Currently we don't support any push-down feature, so there is only one
- *		possible access path, which simply returns all records in the order in
- *		the data file.
+ * OrcEstimateSize fills in the page count of the file and its row count. The
+ * row count comes from the orc footer, which is all that is read of the file
+ * here, together with the bytes the scan will read for the query's columns
+ * and restriction clauses. If the file can't be read, the error is left to
+ * the scan and the row count is guessed from the file size and the tuple
+ * width like file_fdw does.
  */
 static void
-fileGetForeignPaths(PlannerInfo *root,
-                    RelOptInfo *baserel,
-                    Oid foreigntableid)
+OrcEstimateSize(RelOptInfo *baserel, Oid foreignTableId, OrcPlanState *planState)
 {
-    Path *foreignScanPath = NULL;
-    /*
-     * We estimate costs almost the same way as cost_seqscan(), thus assuming
-     * that I/O costs are equivalent to a regular table file of the same size.
-     * However, we take per-tuple CPU costs as 10x of a seqscan to account for
-     * the cost of parsing records.
-     */
-    //List *queryColumnList = ColumnList(baserel, foreigntableid);
-    //uint32 queryColumnCount = (uint32)list_length(queryColumnList);
-    //TODO: can't get page count!!!
-    BlockNumber relationPageCount = SIM_PAGES;
+    struct stat statBuffer;
+    double fileSize = 0;
+    List *columnList = ColumnList(baserel, foreignTableId);
+    List *searchArgumentList = OrcSearchArgumentList(baserel->baserestrictinfo, baserel->relid);
+    int columnCount = baserel->max_attr;
+    bool *projected = (bool *) palloc0(Max(1, columnCount) * sizeof(bool));
+    ListCell *columnCell = NULL;
+    int columnIndex = 0;
+
+    foreach(columnCell, columnList)
+    {
+        Var *column = (Var *) lfirst(columnCell);
 
-    double queryColumnRatio = (double) 1/2;
-    double queryPageCount = relationPageCount * queryColumnRatio;
-    double totalDiskAccessCost = seq_page_cost * queryPageCount;
+        if (column->varattno > 0 && column->varattno <= columnCount)
+        {
+            projected[column->varattno - 1] = true;
+        }
+    }
 
-    //double tupleCountEstimate = (double) actualTotalRowCount;
-    OrcFdwOptions *options = OrcGetOptions(foreigntableid);
-    double tupleCountEstimate = (double) getOrcTupleCount(options->filename);
-    /*
-     * We estimate costs almost the same way as cost_seqscan(), thus assuming
-     * that I/O costs are equivalent to a regular table file of the same size.
-     */
-    double filterCostPerTuple = baserel->baserestrictcost.per_tuple;
-    double cpuCostPerTuple = cpu_tuple_cost + filterCostPerTuple;
-    double totalCpuCost = cpuCostPerTuple * tupleCountEstimate;
+    bool statValid = (stat(planState->options->filename, &statBuffer) == 0);
+    char *fileTail = NULL;
+    Size fileTailLength = 0;
 
-    double startupCost = baserel->baserestrictcost.startup;
-    double totalCost  = startupCost + totalCpuCost + totalDiskAccessCost;
+    /* the tail may have been read by an earlier query of any backend */
+    if (statValid)
+    {
+        fileTail = OrcTailCacheLookup(planState->options->filename, &statBuffer, &fileTailLength);
+    }
 
-    /* create a foreign path node and add it as the only possible path */
-    foreignScanPath = (Path *) create_foreignscan_path(root, baserel, baserel->rows, startupCost,
-                                                       totalCost,
-                                                       NIL, /* no known ordering */
-                                                       NULL, /* not parameterized */
-                                                       NIL); /* no fdw_private */
+    /* how well the stripes' min/max narrow an equality down, for parameterized paths */
+    planState->stripeFraction = (double *) palloc(Max(1, columnCount) * sizeof(double));
+    for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+    {
+        planState->stripeFraction[columnIndex] = 1.0;
+    }
 
-    add_path(baserel, foreignScanPath);
-}
+    planState->fileInfoValid = getOrcFileInfo(planState->options->filename, columnCount, projected,
+                                              OrcBuildSearchArgument(searchArgumentList, baserel->relid,
+                                                                     NULL, 0),
+                                              fileTail, fileTailLength, &planState->fileInfo,
+                                              planState->stripeFraction);
 
-/*
- * fileGetForeignPlan
- *		Create a ForeignScan plan node for scanning the foreign table
- */
-static ForeignScan *
-fileGetForeignPlan(PlannerInfo *root,
-                   RelOptInfo *baserel,
-                   Oid foreigntableid,
-                   ForeignPath *best_path,
-                   List *tlist,
-                   List *scan_clauses)
-{
-    ForeignScan *foreignScan = NULL;
-    List *columnList = NULL;
-    //List *opExpressionList = NIL;
-    List *foreignPrivateList = NIL;
+    if (statValid && planState->fileInfoValid && planState->fileInfo.fileTail != NULL)
+    {
+        OrcTailCacheInsert(planState->options->filename, &statBuffer,
+                           planState->fileInfo.fileTail, planState->fileInfo.fileTailLength);
+    }
 
-    /*
-     * We have no native ability to evaluate restriction clauses, so we just
-     * put all the scanClauses into the plan node's qual list for the executor
-     * to check.
-     */
-    scan_clauses = extract_actual_clauses(scan_clauses, false);
+    /* keep the tail for the executor, the bridge's copy is gone with the next call */
+    if (planState->fileInfoValid && fileTail == NULL && planState->fileInfo.fileTail != NULL)
+    {
+        fileTailLength = planState->fileInfo.fileTailLength;
+        fileTail = (char *) palloc(fileTailLength);
+        memcpy(fileTail, planState->fileInfo.fileTail, fileTailLength);
+    }
 
-    /*
-     * We construct the query document to have MongoDB filter its rows. We could
-     * also construct a column name document here to retrieve only the needed
-     * columns. However, we found this optimization to degrade performance on
-     * the MongoDB server-side, so we instead filter out columns on our side.
-     */
-    //opExpressionList = ApplicableOpExpressionList(baserel);
+    if (planState->fileInfoValid)
+    {
+        planState->sortColumnList = OrcSortColumnList(foreignTableId, planState, fileTail, fileTailLength);
+    }
 
-    /*
-     * As an optimization, we only add columns that are present in the query to
-     * the column mapping hash. To find these columns, we need baserel. We don't
-     * have access to baserel in executor's callback functions, so we get the
-     * column list here and put it into foreign scan node's private list.
-     */
-    //columnList = ColumnList(baserel, foreigntableid);
+    if (planState->fileInfoValid && statValid)
+    {
+        planState->fileTail = fileTail;
+        planState->fileTailLength = fileTailLength;
+        planState->fileStatValid = true;
+        planState->fileInode = (int64) statBuffer.st_ino;
+        planState->fileSize = (int64) statBuffer.st_size;
+        planState->fileMtime = (int64) statBuffer.st_mtime;
+    }
 
-    //foreignPrivateList = list_make1(columnList);
+    if (statValid)
+    {
+        fileSize = (double) statBuffer.st_size;
+    }
+    else if (planState->fileInfoValid)
+    {
+        fileSize = (double) planState->fileInfo.contentLength;
+    }
+    else
+    {
+        /* same as file_fdw: assume 10 pages if the file is missing */
+        fileSize = 10 * BLCKSZ;
+    }
 
-    /* create the foreign scan node */
-    foreignScan = make_foreignscan(tlist, scan_clauses, baserel->relid,
-                                   NIL, /* no expressions to evaluate */
-                                   foreignPrivateList);
+    planState->pageCount = (BlockNumber) Max(1, ceil(fileSize / BLCKSZ));
 
-    return foreignScan;
+    if (planState->fileInfoValid)
+    {
+        planState->tupleCount = (double) planState->fileInfo.rowCount;
+    }
+    else
+    {
+#if PG_VERSION_NUM >= 90600
+        int tupleWidth = MAXALIGN(baserel->reltarget->width) + MAXALIGN(SizeofHeapTupleHeader);
+#else
+        int tupleWidth = MAXALIGN(baserel->width) + MAXALIGN(SizeofHeapTupleHeader);
+#endif
+
+        planState->tupleCount = clamp_row_est(fileSize / (double) tupleWidth);
+    }
 }
 
 /*
- * fileExplainForeignScan
- *		Produce extra output for EXPLAIN
+ * OrcFooterSelectivity estimates the comparisons of the restriction clauses on
+ * columns that were never analyzed from the file's stripe statistics, so a
+ * table created on a new file gets realistic row counts from its first query.
+ * The estimates are cached in the RestrictInfos, where clause_selectivity()
+ * looks first, and range pairs are combined from them as usual. Columns with
+ * pg_statistic rows are left to their statistics.
  */
 static void
-fileExplainForeignScan(ForeignScanState *node, ExplainState *es)
+OrcFooterSelectivity(RelOptInfo *baserel, Oid foreignTableId, OrcPlanState *planState)
 {
-    /* Fetch options --- we only need filename at this point */
-    Oid foreignTableId = RelationGetRelid(node->ss.ss_currentRelation);
-    OrcFdwOptions *options = OrcGetOptions(foreignTableId);
-    ExplainPropertyText("Orc File", options->filename, es);
+    int clauseCount = list_length(baserel->baserestrictinfo);
+    OrcPredicate *comparisons = NULL;
+    RestrictInfo **restrictInfos = NULL;
+    double *selectivity = NULL;
+    int comparisonCount = 0;
+    ListCell *restrictInfoCell = NULL;
+    int comparisonIndex = 0;
 
-    /* Suppress file size if we're not showing cost details */
-    /*if (es->costs)
+    if (!planState->fileInfoValid || clauseCount == 0)
     {
-        struct stat stat_buf;
+        return;
+    }
 
-        if (stat(options->filename, &stat_buf) == 0)
-            ExplainPropertyLong("Orc File Size", (long) stat_buf.st_size, es);
-    }*/
+    comparisons = (OrcPredicate *) palloc0(clauseCount * sizeof(OrcPredicate));
+    restrictInfos = (RestrictInfo **) palloc(clauseCount * sizeof(RestrictInfo *));
+    selectivity = (double *) palloc(clauseCount * sizeof(double));
+
+    foreach(restrictInfoCell, baserel->baserestrictinfo)
+    {
+        RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(restrictInfoCell);
+        Expr *clause = restrictInfo->clause;
+        Var *column = NULL;
+        Const *constant = NULL;
+        OrcPredicateOp predicateOp;
+
+        if (restrictInfo->pseudoconstant || !IsA(clause, OpExpr) ||
+            !OrcComparisonOperands((OpExpr *) clause, baserel->relid, &column, &constant, &predicateOp))
+        {
+            continue;
+        }
+
+        if (SearchSysCacheExists3(STATRELATTINH, ObjectIdGetDatum(foreignTableId),
+                                  Int16GetDatum(column->varattno), BoolGetDatum(false)))
+        {
+            continue;
+        }
+
+        OrcBuildPredicate(clause, baserel->relid, &comparisons[comparisonCount]);
+        restrictInfos[comparisonCount++] = restrictInfo;
+    }
+
+    if (comparisonCount == 0 ||
+        !estimateOrcSelectivity(planState->options->filename, planState->fileTail, planState->fileTailLength,
+                                comparisons, comparisonCount, selectivity))
+    {
+        return;
+    }
+
+    for (comparisonIndex = 0; comparisonIndex < comparisonCount; comparisonIndex++)
+    {
+        if (selectivity[comparisonIndex] >= 0)
+        {
+            restrictInfos[comparisonIndex]->norm_selec = (Selectivity) selectivity[comparisonIndex];
+        }
+    }
 }
 
 /*
- * fileBeginForeignScan
- *		Initiate access to the file by creating CopyState
+ * OrcSortColumnList resolves the sorted_by option to attribute numbers. The
+ * rows within a stripe are taken on trust, but the stripes' min/max of the
+ * first column must ascend without nulls, or the option is ignored. The list
+ * stops at the first column whose order postgres may not share, e.g. a string
+ * column of a collation other than C, as orc compares strings byte-wise.
  */
-static void
-fileBeginForeignScan(ForeignScanState *node, int eflags)
+static List *
+OrcSortColumnList(Oid foreignTableId, OrcPlanState *planState, const char *fileTail, Size fileTailLength)
 {
-    //cjq
-    //logfile = fopen(MYLOGFILE, "w");
-
-    //fprintf(logfile, "%d\n", 12);
-    //fflush(logfile);
-    //fclose(logfile);
-
-    /* Allocate workspace and zero all fields */
-    OrcExeState *orcState;
-    orcState = (OrcExeState *) palloc0(sizeof(OrcExeState));
-
+    List *columnNameList = NIL;
+    List *sortColumnList = NIL;
+    ListCell *columnNameCell = NULL;
 
-    MemoryContext oldcontext = CurrentMemoryContext;
+    if (planState->options->sortedBy == NULL)
+    {
+        return NIL;
+    }
 
-    /*TODO: memory context for palloc*/
-    orcState->orcContext = AllocSetContextCreate(CurrentMemoryContext, "orc_fdw data context",
-                                                 ALLOCSET_DEFAULT_MINSIZE,
-                                                 ALLOCSET_DEFAULT_INITSIZE,
-                                                 ALLOCSET_DEFAULT_MAXSIZE);
+    /* the validator checked the syntax */
+    SplitIdentifierString(pstrdup(planState->options->sortedBy), ',', &columnNameList);
 
-    MemoryContextSwitchTo(orcState->orcContext);
+    foreach(columnNameCell, columnNameList)
+    {
+        char *columnName = (char *) lfirst(columnNameCell);
+        AttrNumber attnum = get_attnum(foreignTableId, columnName);
+        Oid typeId = InvalidOid;
+        int32 typeMod = -1;
+        Oid collationId = InvalidOid;
+        OrcValueKind valueKind;
+
+        if (attnum == InvalidAttrNumber)
+        {
+            ereport(ERROR,
+                    (errcode(ERRCODE_UNDEFINED_COLUMN),
+                            errmsg("column \"%s\" of option \"%s\" does not exist",
+                                   columnName, OPTION_NAME_SORTED_BY)));
+        }
 
+        get_atttypetypmodcoll(foreignTableId, attnum, &typeId, &typeMod, &collationId);
+        if (!OrcValueKindOf(typeId, &valueKind) ||
+            (valueKind == ORC_VALUE_STRING && !lc_collate_is_c(collationId)))
+        {
+            break;
+        }
 
-    TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+        sortColumnList = lappend_int(sortColumnList, attnum);
+    }
 
-    /*
-     * Do nothing in EXPLAIN (no ANALYZE) case.  node->fdw_state stays NULL.
-     */
-    if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
-        return;
+    if (sortColumnList != NIL &&
+        !checkOrcSortOrder(planState->options->filename, linitial_int(sortColumnList) - 1,
+                           fileTail, fileTailLength))
+    {
+        ereport(DEBUG1,
+                (errmsg("ignoring option \"%s\" of foreign table \"%s\"",
+                        OPTION_NAME_SORTED_BY, get_rel_name(foreignTableId)),
+                        errdetail("The stripes of file \"%s\" overlap or hold nulls.",
+                                  planState->options->filename)));
+        return NIL;
+    }
 
-    /* Fetch options of foreign table */
-    Oid foreignTableId = RelationGetRelid(node->ss.ss_currentRelation);
-    OrcFdwOptions *options = OrcGetOptions(foreignTableId);
+    return sortColumnList;
+}
 
-    unsigned int i;
-    /*
-     * Save state in node->fdw_state.  We must save enough information to call
-     * BeginCopyFrom() again.
-     */
+static Const *
+OrcInt8Const(int64 value)
+{
+    return makeConst(INT8OID, -1, InvalidOid, sizeof(int64), Int64GetDatum(value), false, FLOAT8PASSBYVAL);
+}
 
-    orcState->filename = options->filename;
+/* OrcFileTailConst wraps the serialized tail read by the planner into a bytea Const */
+static Const *
+OrcFileTailConst(OrcPlanState *planState)
+{
+    bytea *fileTail = NULL;
 
-    //get colNum
-    orcState->colNum = slot->tts_tupleDescriptor->natts;
-    /*init orc reader (filename, column number, maxRowPerBatch) */
-    initOrcReader(orcState->filename, orcState->colNum, MAX_ROW_PER_BATCH);
+    if (planState->fileTail == NULL || !planState->fileStatValid)
+    {
+        return makeNullConst(BYTEAOID, -1, InvalidOid);
+    }
 
+    fileTail = (bytea *) palloc(planState->fileTailLength + VARHDRSZ);
+    SET_VARSIZE(fileTail, planState->fileTailLength + VARHDRSZ);
+    memcpy(VARDATA(fileTail), planState->fileTail, planState->fileTailLength);
 
-    TupleDesc tupleDescriptor = slot->tts_tupleDescriptor;
-    orcState->tupleDescriptor = tupleDescriptor;
+    return makeConst(BYTEAOID, -1, InvalidOid, -1, PointerGetDatum(fileTail), false, false);
+}
 
+/*
+ * OrcPlanFileTail returns the serialized tail the planner put into the plan,
+ * or NULL if there is none or the file is not the one it was read from.
+ */
+static char *
+OrcPlanFileTail(List *foreignPrivateList, const struct stat *statBuffer, Size *length)
+{
+    Const *fileTailConst = (Const *) list_nth(foreignPrivateList, OrcScanPrivateFileTail);
+    List *fileStatList = (List *) list_nth(foreignPrivateList, OrcScanPrivateFileStat);
+    bytea *fileTail = NULL;
 
-    //init in_functions, typioparams
-    FmgrInfo   *in_functions = (FmgrInfo *) palloc(orcState->colNum * sizeof(FmgrInfo));
-    Oid			in_func_oid;
-    Oid		   *typioparams = (Oid *) palloc(orcState->colNum * sizeof(Oid));
-    Oid typeid;
-    for(i = 0; i < orcState->colNum; i++) {
-        typeid = slot->tts_tupleDescriptor->attrs[i]->atttypid;
-        getTypeInputInfo(typeid, &in_func_oid, &typioparams[i]);
-        fmgr_info(in_func_oid, &in_functions[i]);
+    if (fileTailConst->constisnull)
+    {
+        return NULL;
     }
 
-    orcState->in_functions = in_functions;
-    orcState->typioparams = typioparams;
+    if (DatumGetInt64(((Const *) linitial(fileStatList))->constvalue) != (int64) statBuffer->st_ino ||
+        DatumGetInt64(((Const *) lsecond(fileStatList))->constvalue) != (int64) statBuffer->st_size ||
+        DatumGetInt64(((Const *) lthird(fileStatList))->constvalue) != (int64) statBuffer->st_mtime)
+    {
+        return NULL;
+    }
 
-    /* store query restriction list */
-    ForeignScan *foreignScan = NULL;
-    foreignScan = (ForeignScan *) node->ss.ps.plan;
+    fileTail = DatumGetByteaP(fileTailConst->constvalue);
+    *length = VARSIZE(fileTail) - VARHDRSZ;
 
-    List *foreignPrivateList = NIL;
-    foreignPrivateList = (List *) foreignScan->fdw_private;
+    return VARDATA(fileTail);
+}
 
-    /* real selected column list, which will be passed to orc lib */
-    /* TODO: the difference between columnList and foreignPrivateList, orcState->queryRestrictionList
-     * TODO: print 3 them out, why orcState->queryRestrictionList = (List *) lsecond(foreignPrivateList)*/
-    //List *columnList = NIL;
-    //linitial: get the list's head's data
-    //columnList = (List *) linitial(foreignPrivateList);
+/*
+ * fileGetForeignPaths
+ *		Create possible access paths for a scan on the foreign table
+ *
+ *		The plain path returns all records in the order in the data file. For
+ *		join clauses comparing a column with other relations, parameterized
+ *		paths are added too, which prune stripes by the outer value on every
+ *		rescan.
+ */
+static void
+fileGetForeignPaths(PlannerInfo *root,
+                    RelOptInfo *baserel,
+                    Oid foreigntableid)
+{
+    Path *foreignScanPath = NULL;
+    Cost startupCost = 0;
+    Cost totalCost = 0;
+    List *pathKeys = OrcSortPathKeys(root, baserel, foreigntableid);
 
-    //TODO: why add this line, fdw doesn't work.
-    //orcState->queryRestrictionList = (List *) lsecond(foreignPrivateList);
-    orcState->nextTuple = (char **) palloc(orcState->colNum * sizeof(char *));
+    OrcScanCost(baserel, foreigntableid, 1.0, &startupCost, &totalCost);
 
+    /* create a foreign path node and add it as the only possible path */
+    foreignScanPath = OrcCreateScanPath(root, baserel, baserel->rows, startupCost, totalCost,
+                                        pathKeys, /* sorted_by, if any */
+                                        NULL); /* not parameterized */
 
+    add_path(baserel, foreignScanPath);
 
-    MemoryContextSwitchTo(oldcontext);
+    OrcAddParameterizedPaths(root, baserel, foreigntableid, pathKeys);
 
-    node->fdw_state = (void *) orcState;
+#if PG_VERSION_NUM >= 90600
+    OrcAddPartialPath(root, baserel, foreigntableid, pathKeys);
+#endif
 }
 
-//just for testing
-void itoa(int i, char * s)
+#if PG_VERSION_NUM >= 90600
+/*
+ * OrcAddPartialPath adds the path of a parallel scan, which splits the
+ * selected stripes between its participants. Each of them decodes its own
+ * stripes, so unlike cost_seqscan() the whole run cost is shared out, not
+ * only the CPU part. A participant returns its rows in file order, so the
+ * declared sort order holds for a Gather Merge.
+ */
+static void
+OrcAddPartialPath(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId, List *pathKeys)
 {
-    int len=0, sign=1, k;
-    if(i<0)
+    OrcPlanState *planState = (OrcPlanState *) baserel->fdw_private;
+    Path *partialPath = NULL;
+    Cost startupCost = 0;
+    Cost totalCost = 0;
+    double parallelDivisor = 0;
+    unsigned long long stripeCount = 0;
+    int workerCount = 0;
+
+    if (!baserel->consider_parallel || baserel->lateral_relids != NULL || !planState->fileInfoValid)
     {
-        i*=-1;
-        sign=-1;
+        return;
     }
-    int j=i;
-    while(j>0)
+
+    /* a stripe is the unit of work, a worker needs one at least beside the leader's */
+    stripeCount = planState->fileInfo.stripesSelected;
+    if (stripeCount > 1)
     {
-        len++;
-        j/=10;
+        workerCount = (int) Min((unsigned long long) max_parallel_workers_per_gather, stripeCount - 1);
     }
-
-    for(k=len; k>=1; k--)
+    if (workerCount <= 0)
     {
-        s[k-1]=i%10+'0';
-        i/=10;
+        return;
     }
-    s[len]='\0';
-}
 
-int count = 0;
-//nation: int, string, int, string
-//supplier: int, string, string, int, string, double, string
-//char ss[7][155] = {"1", "mike", "23", "99", "dddd", "5.5", "enen"};
+    /* the leader helps less the more workers there are, as in get_parallel_divisor() */
+    parallelDivisor = workerCount;
+#if PG_VERSION_NUM >= 110000
+    if (parallel_leader_participation)
+#endif
+    {
+        double leaderContribution = 1.0 - (0.3 * workerCount);
 
+        if (leaderContribution > 0)
+        {
+            parallelDivisor += leaderContribution;
+        }
+    }
+
+    OrcScanCost(baserel, foreignTableId, 1.0, &startupCost, &totalCost);
+    totalCost = startupCost + (totalCost - startupCost) / parallelDivisor;
+
+    partialPath = OrcCreateScanPath(root, baserel, clamp_row_est(baserel->rows / parallelDivisor),
+                                    startupCost, totalCost, pathKeys, NULL);
+    partialPath->parallel_aware = true;
+    partialPath->parallel_safe = true;
+    partialPath->parallel_workers = workerCount;
+
+    add_partial_path(baserel, partialPath);
+}
+#endif
+
+/*
+ * OrcCreateScanPath creates a path scanning the foreign table, without
+ * fdw_private, across the versions of create_foreignscan_path().
+ */
+static Path *
+OrcCreateScanPath(PlannerInfo *root, RelOptInfo *baserel, double rows, Cost startupCost,
+                  Cost totalCost, List *pathKeys, Relids requiredOuter)
+{
+#if PG_VERSION_NUM >= 170000
+    return (Path *) create_foreignscan_path(root, baserel, NULL, rows, startupCost, totalCost,
+                                            pathKeys, requiredOuter, NULL, NIL, NIL);
+#elif PG_VERSION_NUM >= 90600
+    return (Path *) create_foreignscan_path(root, baserel, NULL, rows, startupCost, totalCost,
+                                            pathKeys, requiredOuter, NULL, NIL);
+#elif PG_VERSION_NUM >= 90500
+    return (Path *) create_foreignscan_path(root, baserel, rows, startupCost, totalCost,
+                                            pathKeys, requiredOuter, NULL, NIL);
+#else
+    return (Path *) create_foreignscan_path(root, baserel, rows, startupCost, totalCost,
+                                            pathKeys, requiredOuter, NIL);
+#endif
+}
+
+/*
+ * OrcSortPathKeys builds the pathkeys of the file's declared order, as far as
+ * the query has use for them. Skipped stripes don't disturb the order of
+ * the rows that are left.
+ */
+static List *
+OrcSortPathKeys(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId)
+{
+    OrcPlanState *planState = (OrcPlanState *) baserel->fdw_private;
+    List *pathKeys = NIL;
+    ListCell *sortColumnCell = NULL;
+
+    foreach(sortColumnCell, planState->sortColumnList)
+    {
+        AttrNumber attnum = (AttrNumber) lfirst_int(sortColumnCell);
+        Oid typeId = InvalidOid;
+        int32 typeMod = -1;
+        Oid collationId = InvalidOid;
+        TypeCacheEntry *typeEntry = NULL;
+        Var *column = NULL;
+        List *columnPathKeys = NIL;
+
+        get_atttypetypmodcoll(foreignTableId, attnum, &typeId, &typeMod, &collationId);
+        typeEntry = lookup_type_cache(typeId, TYPECACHE_LT_OPR);
+        if (!OidIsValid(typeEntry->lt_opr))
+        {
+            break;
+        }
+
+        column = makeVar(baserel->relid, attnum, typeId, typeMod, collationId, 0);
+#if PG_VERSION_NUM >= 160000
+        columnPathKeys = build_expression_pathkey(root, (Expr *) column, typeEntry->lt_opr,
+                                                  baserel->relids, false);
+#else
+        columnPathKeys = build_expression_pathkey(root, (Expr *) column, NULL, typeEntry->lt_opr,
+                                                  baserel->relids, false);
+#endif
+
+        /* a later column only orders the rows the earlier ones tie */
+        if (columnPathKeys == NIL)
+        {
+            break;
+        }
+        pathKeys = list_concat(pathKeys, columnPathKeys);
+    }
+
+    return pathKeys;
+}
+
+/*
+ * OrcScanCost estimates a scan reading stripeFraction of the stripes the
+ * restriction clauses leave.
+ */
+static void
+OrcScanCost(RelOptInfo *baserel, Oid foreignTableId, double stripeFraction,
+            Cost *startupCost, Cost *totalCost)
+{
+    /*
+     * We estimate costs almost the same way as cost_seqscan(), thus assuming
+     * that I/O costs are equivalent to a regular table file of the same size.
+     * However, we take per-tuple CPU costs as 10x of a seqscan to account for
+     * the cost of parsing records.
+     */
+    OrcPlanState *planState = (OrcPlanState *) baserel->fdw_private;
+    double queryPageCount = 0;
+    double tupleCountEstimate = 0;
+
+    if (planState->fileInfoValid)
+    {
+        /*
+         * Only the streams of the queried columns in the stripes the restriction
+         * clauses don't rule out are read, and only their rows are processed.
+         */
+        queryPageCount = ceil((double) planState->fileInfo.readBytes * stripeFraction / BLCKSZ);
+        tupleCountEstimate = (double) planState->fileInfo.selectedRowCount * stripeFraction;
+    }
+    else
+    {
+        /* the file can't be read yet, assume a share by column count */
+        List *queryColumnList = ColumnList(baserel, foreignTableId);
+        double queryColumnCount = Max(1, list_length(queryColumnList));
+        double relationColumnCount = Max(1, baserel->max_attr);
+
+        queryPageCount = ceil(planState->pageCount * Min(1.0, queryColumnCount / relationColumnCount));
+        tupleCountEstimate = planState->tupleCount;
+    }
+
+    double totalDiskAccessCost = seq_page_cost * queryPageCount;
+    /*
+     * We estimate costs almost the same way as cost_seqscan(), thus assuming
+     * that I/O costs are equivalent to a regular table file of the same size.
+     */
+    double filterCostPerTuple = baserel->baserestrictcost.per_tuple;
+    double cpuCostPerTuple = cpu_tuple_cost + filterCostPerTuple;
+    double totalCpuCost = cpuCostPerTuple * tupleCountEstimate;
+
+    *startupCost = baserel->baserestrictcost.startup;
+    *totalCost = *startupCost + totalCpuCost + totalDiskAccessCost;
+}
+
+/*
+ * OrcAddParameterizedPaths adds a path per set of outer relations that join
+ * clauses like inner.key = outer.key can take their values from, whether the
+ * clause is written out or implied by an equivalence class. Such a scan only
+ * reads the stripes whose min/max admit the outer value, so on
+ * a file clustered by the key it behaves like an index nested loop.
+ */
+static void
+OrcAddParameterizedPaths(PlannerInfo *root, RelOptInfo *baserel, Oid foreignTableId,
+                         List *pathKeys)
+{
+    OrcPlanState *planState = (OrcPlanState *) baserel->fdw_private;
+    List *clauseList = NIL;
+    List *requiredOuterList = NIL;
+    ListCell *clauseCell = NULL;
+
+    if (!planState->fileInfoValid)
+    {
+        return;
+    }
+
+    foreach(clauseCell, baserel->joininfo)
+    {
+        RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(clauseCell);
+
+        if (join_clause_is_movable_to(restrictInfo, baserel))
+        {
+            clauseList = lappend(clauseList, restrictInfo);
+        }
+    }
+
+    if (baserel->has_eclass_joins)
+    {
+        clauseList = list_concat(clauseList,
+                                 generate_implied_equalities_for_column(root, baserel, OrcEclassMemberMatches,
+                                                                        NULL, baserel->lateral_referencers));
+    }
+
+    foreach(clauseCell, clauseList)
+    {
+        RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(clauseCell);
+        Relids requiredOuter = NULL;
+        ParamPathInfo *paramInfo = NULL;
+        ListCell *outerCell = NULL;
+        ListCell *paramClauseCell = NULL;
+        double stripeFraction = 1.0;
+        Cost startupCost = 0;
+        Cost totalCost = 0;
+        bool seen = false;
+
+        if (!OrcParameterClause(restrictInfo, baserel, NULL, NULL))
+        {
+            continue;
+        }
+
+        requiredOuter = bms_union(restrictInfo->clause_relids, baserel->lateral_relids);
+        requiredOuter = bms_del_member(requiredOuter, baserel->relid);
+        if (bms_is_empty(requiredOuter))
+        {
+            continue;
+        }
+
+        foreach(outerCell, requiredOuterList)
+        {
+            seen = seen || bms_equal((Relids) lfirst(outerCell), requiredOuter);
+        }
+        if (seen)
+        {
+            continue;
+        }
+        requiredOuterList = lappend(requiredOuterList, requiredOuter);
+
+        /* the most selective key decides how many stripes a rescan reads */
+        paramInfo = get_baserel_parampathinfo(root, baserel, requiredOuter);
+        foreach(paramClauseCell, paramInfo->ppi_clauses)
+        {
+            Var *column = NULL;
+
+            if (OrcParameterClause((RestrictInfo *) lfirst(paramClauseCell), baserel, &column, NULL))
+            {
+                stripeFraction = Min(stripeFraction, planState->stripeFraction[column->varattno - 1]);
+            }
+        }
+
+        /* a rescan checks every stripe's statistics, even if it reads one */
+        OrcScanCost(baserel, foreignTableId, stripeFraction, &startupCost, &totalCost);
+        totalCost += cpu_operator_cost * planState->fileInfo.stripesSelected;
+
+        add_path(baserel, OrcCreateScanPath(root, baserel, paramInfo->ppi_rows, startupCost, totalCost,
+                                            pathKeys, requiredOuter));
+    }
+}
+
+/*
+ * OrcEclassMemberMatches picks the column of an equivalence class that a
+ * parameterized path can prune by.
+ */
+static bool
+OrcEclassMemberMatches(PlannerInfo *root, RelOptInfo *baserel, EquivalenceClass *eclass,
+                       EquivalenceMember *member, void *arg)
+{
+    Expr *expr = member->em_expr;
+    OrcValueKind valueKind;
+
+    if (IsA(expr, RelabelType))
+    {
+        expr = ((RelabelType *) expr)->arg;
+    }
+
+    return IsA(expr, Var) && ((Var *) expr)->varno == baserel->relid && ((Var *) expr)->varattno > 0 &&
+           ((Var *) expr)->varlevelsup == 0 && OrcValueKindOf(((Var *) expr)->vartype, &valueKind);
+}
+
+/*
+ * OrcParameterClause checks whether the join clause is an equality between a
+ * column of the relation and an expression of other relations only, which
+ * the scan can evaluate at rescan and prune the stripes by. If so, it returns
+ * both sides.
+ */
+static bool
+OrcParameterClause(RestrictInfo *restrictInfo, RelOptInfo *baserel, Var **column, Expr **parameter)
+{
+    OpExpr *opExpr = (OpExpr *) restrictInfo->clause;
+    Node *leftOperand = NULL;
+    Node *rightOperand = NULL;
+    Node *columnOperand = NULL;
+    Node *parameterOperand = NULL;
+    Oid opclassId = InvalidOid;
+    OrcValueKind columnKind;
+    OrcValueKind parameterKind;
+
+    if (!IsA(opExpr, OpExpr) || list_length(opExpr->args) != 2 || restrictInfo->pseudoconstant)
+    {
+        return false;
+    }
+
+    leftOperand = (Node *) linitial(opExpr->args);
+    rightOperand = (Node *) lsecond(opExpr->args);
+
+    if (bms_equal(restrictInfo->left_relids, baserel->relids) &&
+        !bms_overlap(restrictInfo->right_relids, baserel->relids))
+    {
+        columnOperand = leftOperand;
+        parameterOperand = rightOperand;
+    }
+    else if (bms_equal(restrictInfo->right_relids, baserel->relids) &&
+             !bms_overlap(restrictInfo->left_relids, baserel->relids))
+    {
+        columnOperand = rightOperand;
+        parameterOperand = leftOperand;
+    }
+    else
+    {
+        return false;
+    }
+
+    /* varchar columns are compared as text */
+    if (IsA(columnOperand, RelabelType))
+    {
+        columnOperand = (Node *) ((RelabelType *) columnOperand)->arg;
+    }
+
+    if (!IsA(columnOperand, Var) || ((Var *) columnOperand)->varattno <= 0 ||
+        contain_volatile_functions(parameterOperand))
+    {
+        return false;
+    }
+
+    if (!OrcValueKindOf(((Var *) columnOperand)->vartype, &columnKind) ||
+        !OrcValueKindOf(exprType(parameterOperand), &parameterKind) ||
+        columnKind != parameterKind)
+    {
+        return false;
+    }
+
+    /* equality is symmetric, so the operand order doesn't matter */
+    opclassId = GetDefaultOpClass(((Var *) columnOperand)->vartype, BTREE_AM_OID);
+    if (!OidIsValid(opclassId) ||
+        get_op_opfamily_strategy(opExpr->opno, get_opclass_family(opclassId)) != BTEqualStrategyNumber)
+    {
+        return false;
+    }
+
+    if (column != NULL)
+    {
+        *column = (Var *) columnOperand;
+    }
+    if (parameter != NULL)
+    {
+        *parameter = (Expr *) parameterOperand;
+    }
+
+    return true;
+}
+
+#if PG_VERSION_NUM >= 90600
+/*
+ * fileGetForeignUpperPaths
+ *		Add a path answering the aggregates of the query from the file
+ *
+ *		Queries without GROUP BY whose every output is count(*), or count(),
+ *		min(), max() or sum() of a column, over rows the restriction clauses
+ *		select row by row, are answered by the bridge. The stripes that all
+ *		or none of the rows satisfy the clauses in are answered by the stripe
+ *		statistics, only the others are read. Files whose statistics are
+ *		known to be wrong are left to the plain scan.
+ */
+static void
+#if PG_VERSION_NUM >= 110000
+fileGetForeignUpperPaths(PlannerInfo *root, UpperRelationKind stage, RelOptInfo *inputRel,
+                         RelOptInfo *outputRel, void *extra)
+#else
+fileGetForeignUpperPaths(PlannerInfo *root, UpperRelationKind stage, RelOptInfo *inputRel,
+                         RelOptInfo *outputRel)
+#endif
+{
+    Query *parse = root->parse;
+    OrcPlanState *planState = (OrcPlanState *) inputRel->fdw_private;
+    PathTarget *groupingTarget = root->upper_targets[UPPERREL_GROUP_AGG];
+    List *searchArgumentList = NIL;
+    List *aggregateList = NIL;
+    List *pathPrivate = NIL;
+    ListCell *cell = NULL;
+    OrcAggregateStats aggregateStats;
+    double decodedShare = 0;
+    Cost totalCost = 0;
+    Path *aggregatePath = NULL;
+
+    if (stage != UPPERREL_GROUP_AGG || inputRel->reloptkind != RELOPT_BASEREL ||
+        outputRel->fdw_private != NULL || planState == NULL || !planState->fileInfoValid)
+    {
+        return;
+    }
+
+    if (parse->groupClause != NIL || parse->groupingSets != NIL || parse->havingQual != NULL ||
+        inputRel->lateral_relids != NULL)
+    {
+        return;
+    }
+
+    /* the bridge must decide every clause row by row, it checks them for exactness */
+    foreach(cell, inputRel->baserestrictinfo)
+    {
+        RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(cell);
+        Expr *clause = OrcSearchArgumentClause(restrictInfo->clause, inputRel->relid);
+
+        if (restrictInfo->pseudoconstant || clause == NULL || !equal(clause, restrictInfo->clause))
+        {
+            return;
+        }
+        searchArgumentList = lappend(searchArgumentList, clause);
+    }
+
+    foreach(cell, groupingTarget->exprs)
+    {
+        if (!OrcAggregateTarget((Expr *) lfirst(cell), inputRel->relid, &aggregateList))
+        {
+            return;
+        }
+    }
+
+    if (aggregateList == NIL ||
+        !estimateOrcAggregates(planState->options->filename, inputRel->max_attr,
+                               OrcBuildSearchArgument(searchArgumentList, inputRel->relid, NULL, 0),
+                               planState->fileTail, planState->fileTailLength,
+                               OrcAggregateArray(aggregateList), list_length(aggregateList),
+                               &aggregateStats))
+    {
+        return;
+    }
+
+    /*
+     * Parsing the stripe statistics is cheap, the stripes they can't answer
+     * are read like a scan of theirs would.
+     */
+    if (planState->fileInfo.selectedRowCount > 0)
+    {
+        decodedShare = Min(1.0, (double) aggregateStats.rowsDecoded / planState->fileInfo.selectedRowCount);
+    }
+    totalCost = cpu_operator_cost * aggregateStats.stripeCount +
+                seq_page_cost * ceil((double) planState->fileInfo.readBytes * decodedShare / BLCKSZ) +
+                (cpu_tuple_cost + cpu_operator_cost * list_length(aggregateList)) *
+                aggregateStats.rowsDecoded;
+
+    pathPrivate = list_make3(aggregateList, searchArgumentList,
+                             list_make2_int(inputRel->relid, inputRel->max_attr));
+
+    /* the plan reads the file's name and tail from here */
+    outputRel->fdw_private = planState;
+
+#if PG_VERSION_NUM >= 170000
+    aggregatePath = (Path *) create_foreign_upper_path(root, outputRel, groupingTarget, 1, totalCost,
+                                                       totalCost, NIL, NULL, NIL, pathPrivate);
+#elif PG_VERSION_NUM >= 110000
+    aggregatePath = (Path *) create_foreign_upper_path(root, outputRel, groupingTarget, 1, totalCost,
+                                                       totalCost, NIL, NULL, pathPrivate);
+#else
+    aggregatePath = (Path *) create_foreignscan_path(root, outputRel, groupingTarget, 1, totalCost,
+                                                     totalCost, NIL, NULL, NULL, pathPrivate);
+#endif
+
+    add_path(outputRel, aggregatePath);
+}
+
+/*
+ * OrcAggregateTarget checks that expr is an aggregate the bridge computes,
+ * count(*), or count(), min(), max() or sum() of a plain column, and appends
+ * its description to aggregateList. Sums are left to postgres but for int2,
+ * int4 and float8, whose results the bridge's int8 and double sums are.
+ */
+static bool
+OrcAggregateTarget(Expr *expr, Index relid, List **aggregateList)
+{
+    Aggref *aggref = (Aggref *) expr;
+    char *aggregateName = NULL;
+    Node *argument = NULL;
+    Var *column = NULL;
+    OrcAggregateKind aggregateKind;
+    OrcValueKind valueKind = ORC_VALUE_INT;
+
+    if (!IsA(expr, Aggref) || aggref->aggorder != NIL || aggref->aggdistinct != NIL ||
+        aggref->aggfilter != NULL || aggref->aggkind != AGGKIND_NORMAL ||
+        aggref->aggsplit != AGGSPLIT_SIMPLE || aggref->agglevelsup != 0 ||
+        get_func_namespace(aggref->aggfnoid) != PG_CATALOG_NAMESPACE)
+    {
+        return false;
+    }
+
+    aggregateName = get_func_name(aggref->aggfnoid);
+
+    if (aggref->aggstar)
+    {
+        if (strcmp(aggregateName, "count") != 0)
+        {
+            return false;
+        }
+
+        *aggregateList = lappend(*aggregateList,
+                                 list_make4_int(ORC_AGGREGATE_COUNT_ROWS, 0, valueKind, aggref->aggtype));
+        return true;
+    }
+
+    if (list_length(aggref->args) != 1)
+    {
+        return false;
+    }
+
+    /* varchar columns are aggregated as text */
+    argument = (Node *) ((TargetEntry *) linitial(aggref->args))->expr;
+    if (IsA(argument, RelabelType))
+    {
+        argument = (Node *) ((RelabelType *) argument)->arg;
+    }
+
+    column = (Var *) argument;
+    if (!IsA(argument, Var) || column->varno != relid || column->varlevelsup != 0 ||
+        column->varattno <= 0 || !OrcValueKindOf(column->vartype, &valueKind))
+    {
+        return false;
+    }
+
+    if (strcmp(aggregateName, "count") == 0)
+    {
+        aggregateKind = ORC_AGGREGATE_COUNT;
+    }
+    else if (strcmp(aggregateName, "min") == 0 || strcmp(aggregateName, "max") == 0)
+    {
+        aggregateKind = (aggregateName[1] == 'i') ? ORC_AGGREGATE_MIN : ORC_AGGREGATE_MAX;
+
+        /* orc compares strings byte-wise, and varchar(n) values may need clipping */
+        if (valueKind == ORC_VALUE_STRING &&
+            (!lc_collate_is_c(aggref->inputcollid) || column->vartypmod >= 0))
+        {
+            return false;
+        }
+    }
+    else if (strcmp(aggregateName, "sum") == 0 &&
+             (column->vartype == INT2OID || column->vartype == INT4OID || column->vartype == FLOAT8OID))
+    {
+        aggregateKind = ORC_AGGREGATE_SUM;
+    }
+    else
+    {
+        return false;
+    }
+
+    *aggregateList = lappend(*aggregateList,
+                             list_make4_int(aggregateKind, column->varattno - 1, valueKind, aggref->aggtype));
+    return true;
+}
+#endif
+
+/*
+ * fileGetForeignPlan
+ *		Create a ForeignScan plan node for scanning the foreign table
+ */
+static ForeignScan *
+fileGetForeignPlan(PlannerInfo *root,
+                   RelOptInfo *baserel,
+                   Oid foreigntableid,
+                   ForeignPath *best_path,
+                   List *tlist,
+                   List *scan_clauses)
+{
+    OrcPlanState *planState = (OrcPlanState *) baserel->fdw_private;
+    ForeignScan *foreignScan = NULL;
+    List *columnList = NIL;
+    List *searchArgumentList = NIL;
+    List *filterList = NIL;
+    List *parameterList = NIL;
+    List *parameterExprs = NIL;
+    List *localExprs = NIL;
+    List *foreignPrivateList = NIL;
+    ListCell *restrictInfoCell = NULL;
+
+#if PG_VERSION_NUM >= 90600
+    /* the aggregates of the query, see fileGetForeignUpperPaths */
+    if (baserel->reloptkind == RELOPT_UPPER_REL)
+    {
+        return OrcAggregatePlan(baserel, best_path, tlist);
+    }
+#endif
+
+    /*
+     * As an optimization, we only read columns that are present in the query
+     * from the orc file. To find these columns, we need baserel. We don't
+     * have access to baserel in executor's callback functions, so we get the
+     * column list here and put it into foreign scan node's private list.
+     */
+    columnList = ColumnList(baserel, foreigntableid);
+
+    /*
+     * Restriction clauses that orc column statistics can answer are also
+     * passed down, so that stripes which can't match are never read.
+     */
+    searchArgumentList = OrcSearchArgumentList(baserel->baserestrictinfo, baserel->relid);
+
+    /*
+     * Comparisons on integer, float and date columns are also evaluated by
+     * the bridge on the raw orc batches, so they are left out of the qual
+     * list. Everything else goes to the executor to check.
+     */
+    foreach(restrictInfoCell, scan_clauses)
+    {
+        RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(restrictInfoCell);
+        int searchArgumentIndex = OrcListPosition(searchArgumentList, restrictInfo->clause);
+        Var *column = NULL;
+        Expr *parameter = NULL;
+
+        if (restrictInfo->pseudoconstant)
+        {
+            continue;
+        }
+
+        /*
+         * The outer side of the join clauses of a parameterized path is
+         * evaluated at every rescan to prune the stripes. The clause itself
+         * is still checked by the executor.
+         */
+        if (best_path->path.param_info != NULL &&
+            OrcParameterClause(restrictInfo, baserel, &column, &parameter))
+        {
+            parameterList = lappend(parameterList,
+                                    list_make2_int(column->varattno, exprType((Node *) parameter)));
+            parameterExprs = lappend(parameterExprs, parameter);
+        }
+
+        if (searchArgumentIndex >= 0 && OrcFilterableClause(restrictInfo->clause, baserel->relid))
+        {
+            filterList = lappend_int(filterList, searchArgumentIndex);
+        }
+        else
+        {
+            localExprs = lappend(localExprs, restrictInfo->clause);
+        }
+    }
+
+    foreignPrivateList = list_make3(columnList, searchArgumentList, filterList);
+
+    /*
+     * The file's name and the footer read for the estimates travel with the
+     * plan, so the executor opens the file without looking up the options
+     * or reading the footer again.
+     */
+    foreignPrivateList = lappend(foreignPrivateList, makeString(planState->options->filename));
+    foreignPrivateList = lappend(foreignPrivateList, OrcFileTailConst(planState));
+    foreignPrivateList = lappend(foreignPrivateList,
+                                 list_make3(OrcInt8Const(planState->fileInode),
+                                            OrcInt8Const(planState->fileSize),
+                                            OrcInt8Const(planState->fileMtime)));
+    foreignPrivateList = lappend(foreignPrivateList, parameterList);
+    foreignPrivateList = lappend(foreignPrivateList,
+                                 makeInteger(planState->sortColumnList != NIL ?
+                                             linitial_int(planState->sortColumnList) - 1 : -1));
+
+    /* create the foreign scan node, the outer Vars in fdw_exprs become Params */
+#if PG_VERSION_NUM >= 90500
+    foreignScan = make_foreignscan(tlist, localExprs, baserel->relid,
+                                   parameterExprs,
+                                   foreignPrivateList,
+                                   NIL, NIL, NULL);
+#else
+    foreignScan = make_foreignscan(tlist, localExprs, baserel->relid,
+                                   parameterExprs,
+                                   foreignPrivateList);
+#endif
+
+    return foreignScan;
+}
+
+#if PG_VERSION_NUM >= 90600
+/*
+ * OrcAggregatePlan creates the ForeignScan of an aggregate path, which
+ * returns one row of the aggregates in the order of fdw_scan_tlist. The
+ * file's name and tail are at the same places in fdw_private as in a scan
+ * of the table.
+ */
+static ForeignScan *
+OrcAggregatePlan(RelOptInfo *upperRel, ForeignPath *bestPath, List *tlist)
+{
+    OrcPlanState *planState = (OrcPlanState *) upperRel->fdw_private;
+    List *pathPrivate = bestPath->fdw_private;
+    List *scanTargetList = NIL;
+    List *foreignPrivateList = NIL;
+    ListCell *exprCell = NULL;
+
+    foreach(exprCell, bestPath->path.pathtarget->exprs)
+    {
+        scanTargetList = lappend(scanTargetList,
+                                 makeTargetEntry((Expr *) copyObject(lfirst(exprCell)),
+                                                 list_length(scanTargetList) + 1, NULL, false));
+    }
+
+    foreignPrivateList = list_make3(NIL, lsecond(pathPrivate), NIL);
+    foreignPrivateList = lappend(foreignPrivateList, makeString(planState->options->filename));
+    foreignPrivateList = lappend(foreignPrivateList, OrcFileTailConst(planState));
+    foreignPrivateList = lappend(foreignPrivateList,
+                                 list_make3(OrcInt8Const(planState->fileInode),
+                                            OrcInt8Const(planState->fileSize),
+                                            OrcInt8Const(planState->fileMtime)));
+    foreignPrivateList = lappend(foreignPrivateList, NIL);
+    foreignPrivateList = lappend(foreignPrivateList, makeInteger(-1));
+    foreignPrivateList = lappend(foreignPrivateList, linitial(pathPrivate));
+    foreignPrivateList = lappend(foreignPrivateList, lthird(pathPrivate));
+
+    /* no relation is scanned, the output refers to fdw_scan_tlist */
+    return make_foreignscan(tlist, NIL, 0, NIL, foreignPrivateList, scanTargetList, NIL, NULL);
+}
+#endif
+
+/* OrcAggregateArray makes the bridge's aggregates out of the planner's descriptions */
+static OrcAggregate *
+OrcAggregateArray(List *aggregateList)
+{
+    OrcAggregate *aggregates = (OrcAggregate *) palloc0(Max(1, list_length(aggregateList)) *
+                                                        sizeof(OrcAggregate));
+    ListCell *aggregateCell = NULL;
+    int aggregateIndex = 0;
+
+    foreach(aggregateCell, aggregateList)
+    {
+        List *aggregate = (List *) lfirst(aggregateCell);
+
+        aggregates[aggregateIndex].kind = (OrcAggregateKind) linitial_int(aggregate);
+        aggregates[aggregateIndex].column = (unsigned int) lsecond_int(aggregate);
+        aggregates[aggregateIndex].valueKind = (OrcValueKind) lthird_int(aggregate);
+        aggregateIndex++;
+    }
+
+    return aggregates;
+}
+
+/*
+ * fileExplainForeignScan
+ *		Produce extra output for EXPLAIN
+ */
+static void
+fileExplainForeignScan(ForeignScanState *node, ExplainState *es)
+{
+    /* the filename was put into the plan by fileGetForeignPlan */
+    ForeignScan *foreignScan = (ForeignScan *) node->ss.ps.plan;
+    char *filename = strVal(list_nth(foreignScan->fdw_private, OrcScanPrivateFilename));
+    ExplainPropertyText("Orc File", filename, es);
+
+    /* counters of the scan, only known after running */
+    if (es->analyze && node->fdw_state != NULL)
+    {
+        OrcExeState *orcState = (OrcExeState *) node->fdw_state;
+        OrcScanStats stats;
+
+        if (orcState->aggregates != NULL)
+        {
+            ExplainPropertyLong("Orc Stripes", (long) orcState->aggregateStats.stripeCount, es);
+            ExplainPropertyLong("Orc Stripes Skipped", (long) orcState->aggregateStats.stripesSkipped, es);
+            ExplainPropertyLong("Orc Stripes Answered by Statistics",
+                                (long) orcState->aggregateStats.stripesAnswered, es);
+            ExplainPropertyLong("Orc Stripes Decoded", (long) orcState->aggregateStats.stripesDecoded, es);
+            return;
+        }
+
+        getOrcScanStats(orcState->reader, &stats);
+
+        ExplainPropertyLong("Orc Stripes", (long) stats.stripeCount, es);
+        ExplainPropertyLong("Orc Stripes Skipped", (long) stats.stripesSkipped, es);
+        ExplainPropertyLong("Orc Stripes Cached", (long) stats.stripesCached, es);
+        ExplainPropertyLong("Orc Stripes Read Ahead", (long) stats.stripesReadAhead, es);
+        ExplainPropertyLong("Orc Rows Removed by Filter", (long) stats.rowsFiltered, es);
+        ExplainPropertyLong("Orc Peak Memory (kB)", (long) ((stats.peakMemory + 1023) / 1024), es);
+    }
+
+    /* Suppress file size if we're not showing cost details */
+    /*if (es->costs)
+    {
+        struct stat stat_buf;
+
+        if (stat(options->filename, &stat_buf) == 0)
+            ExplainPropertyLong("Orc File Size", (long) stat_buf.st_size, es);
+    }*/
+}
+
+/*
+ * fileBeginForeignScan
+ *		Initiate access to the file by creating CopyState
+ */
+static void
+fileBeginForeignScan(ForeignScanState *node, int eflags)
+{
+    //cjq
+    //logfile = fopen(MYLOGFILE, "w");
+
+    //fprintf(logfile, "%d\n", 12);
+    //fflush(logfile);
+    //fclose(logfile);
+
+    /*
+     * Do nothing in EXPLAIN (no ANALYZE) case.  node->fdw_state stays NULL.
+     */
+    if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+        return;
+
+    /* Allocate workspace and zero all fields */
+    OrcExeState *orcState;
+    orcState = (OrcExeState *) palloc0(sizeof(OrcExeState));
+
+
+    MemoryContext oldcontext = CurrentMemoryContext;
+
+    /*TODO: memory context for palloc*/
+    orcState->orcContext = AllocSetContextCreate(CurrentMemoryContext, "orc_fdw data context",
+                                                 ALLOCSET_DEFAULT_MINSIZE,
+                                                 ALLOCSET_DEFAULT_INITSIZE,
+                                                 ALLOCSET_DEFAULT_MAXSIZE);
+
+    MemoryContextSwitchTo(orcState->orcContext);
+
+
+    TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+
+    ForeignScan *foreignScan = (ForeignScan *) node->ss.ps.plan;
+    List *foreignPrivateList = (List *) foreignScan->fdw_private;
+
+    unsigned int i;
+    /*
+     * Save state in node->fdw_state.  We must save enough information to call
+     * BeginCopyFrom() again.
+     */
+
+    orcState->filename = strVal(list_nth(foreignPrivateList, OrcScanPrivateFilename));
+
+    /* an aggregate scan has no relation, only the row of its aggregates */
+    if (foreignScan->scan.scanrelid == 0)
+    {
+        OrcBeginAggregateScan(node, orcState);
+        MemoryContextSwitchTo(oldcontext);
+        node->fdw_state = (void *) orcState;
+        return;
+    }
+
+    //get colNum
+    orcState->colNum = slot->tts_tupleDescriptor->natts;
+
+    TupleDesc tupleDescriptor = slot->tts_tupleDescriptor;
+    orcState->tupleDescriptor = tupleDescriptor;
+
+    /* only the columns the query references are read from the file */
+    List *columnList = (List *) list_nth(foreignPrivateList, OrcScanPrivateColumnList);
+    bool *projected = (bool *) palloc0(orcState->colNum * sizeof(bool));
+    ListCell *columnCell = NULL;
+
+    foreach(columnCell, columnList)
+    {
+        Var *column = (Var *) lfirst(columnCell);
+
+        projected[column->varattno - 1] = true;
+    }
+
+    /* the bridge converts each column by its type, dropped columns are passed as InvalidOid */
+    Oid *typeIds = (Oid *) palloc(orcState->colNum * sizeof(Oid));
+    int32 *typeMods = (int32 *) palloc(orcState->colNum * sizeof(int32));
+    for(i = 0; i < orcState->colNum; i++) {
+        Form_pg_attribute attr = TupleDescAttr(tupleDescriptor, i);
+
+        typeIds[i] = attr->attisdropped ? InvalidOid : attr->atttypid;
+        typeMods[i] = attr->atttypmod;
+    }
+
+    orcState->textFallback = (bool *) palloc(orcState->colNum * sizeof(bool));
+
+    /* arena of one batch's by-reference values, reset by the bridge per batch */
+    orcState->batchContext = AllocSetContextCreate(orcState->orcContext, "orc_fdw batch context",
+                                                   ALLOCSET_DEFAULT_MINSIZE,
+                                                   ALLOCSET_DEFAULT_INITSIZE,
+                                                   ALLOCSET_DEFAULT_MAXSIZE);
+
+    /* the orc lib's read and decompression buffers, freed in bulk at the end of the scan */
+    orcState->decodeContext = AllocSetContextCreate(orcState->orcContext, "orc_fdw decode context",
+                                                    ALLOCSET_DEFAULT_MINSIZE,
+                                                    ALLOCSET_DEFAULT_INITSIZE,
+                                                    ALLOCSET_DEFAULT_MAXSIZE);
+
+    /*init orc reader (filename, column number, maxRowPerBatch, column types) */
+    /*
+     * Open the file from the tail the planner read, or else from the cached
+     * one, if the file hasn't changed since. A cached plan may outlive it.
+     */
+    struct stat statBuffer;
+    bool statValid = (stat(orcState->filename, &statBuffer) == 0);
+    char *fileTail = NULL;
+    Size fileTailLength = 0;
+
+    if (statValid)
+    {
+        fileTail = OrcPlanFileTail(foreignPrivateList, &statBuffer, &fileTailLength);
+    }
+
+    bool planFileValid = (fileTail != NULL);
+
+    if (statValid && !planFileValid)
+    {
+        fileTail = OrcTailCacheLookup(orcState->filename, &statBuffer, &fileTailLength);
+    }
+
+    orcState->reader = initOrcReader(orcState->filename, orcState->colNum, MAX_ROW_PER_BATCH,
+                                     typeIds, typeMods, projected, orcState->textFallback,
+                                     orcState->batchContext, orcState->decodeContext,
+                                     fileTail, fileTailLength);
+
+    /* the stripes' order was checked on the file the plan was made for */
+    if (planFileValid)
+    {
+        setOrcSortOrder(orcState->reader, intVal(list_nth(foreignPrivateList, OrcScanPrivateSortColumn)));
+    }
+
+    setOrcReadAhead(orcState->reader, (unsigned int) orc_decode_threads, (unsigned int) orc_decode_column_groups,
+                    (size_t) work_mem * 1024L);
+
+    if (statValid && fileTail == NULL)
+    {
+        const char *readTail = NULL;
+        size_t readTailLength = 0;
+
+        getOrcSerializedTail(orcState->reader, &readTail, &readTailLength);
+        OrcTailCacheInsert(orcState->filename, &statBuffer, readTail, readTailLength);
+    }
+
+    //init in_functions, typioparams, only needed by the text fallback columns
+    FmgrInfo   *in_functions = (FmgrInfo *) palloc(orcState->colNum * sizeof(FmgrInfo));
+    Oid			in_func_oid;
+    Oid		   *typioparams = (Oid *) palloc(orcState->colNum * sizeof(Oid));
+    for(i = 0; i < orcState->colNum; i++) {
+        if (!orcState->textFallback[i])
+            continue;
+
+        getTypeInputInfo(typeIds[i], &in_func_oid, &typioparams[i]);
+        fmgr_info(in_func_oid, &in_functions[i]);
+    }
+
+    orcState->in_functions = in_functions;
+    orcState->typioparams = typioparams;
+
+    /* skip the stripes whose statistics rule out the pushed down clauses */
+    List *searchArgumentList = (List *) list_nth(foreignPrivateList, OrcScanPrivateSearchArgument);
+    List *filterList = (List *) list_nth(foreignPrivateList, OrcScanPrivateFilterList);
+    bool *filtered = (bool *) palloc0((list_length(searchArgumentList) + 1) * sizeof(bool));
+    List *recheckList = NIL;
+    ListCell *filterCell = NULL;
+
+    setOrcSearchArgument(orcState->reader,
+                         OrcBuildSearchArgument(searchArgumentList, foreignScan->scan.scanrelid, NULL, 0),
+                         filtered);
+
+    /*
+     * The join parameters are only set once the outer side has a row, they
+     * are applied before the first batch of every scan, see OrcApplyParameters.
+     */
+    orcState->searchArgumentList = searchArgumentList;
+    orcState->parameterList = (List *) list_nth(foreignPrivateList, OrcScanPrivateParameterList);
+    if (orcState->parameterList != NIL)
+    {
+#if PG_VERSION_NUM >= 100000
+        orcState->parameterExprs = ExecInitExprList(foreignScan->fdw_exprs, (PlanState *) node);
+#else
+        orcState->parameterExprs = (List *) ExecInitExpr((Expr *) foreignScan->fdw_exprs, (PlanState *) node);
+#endif
+        orcState->parametersPending = true;
+    }
+
+    /*
+     * The planner left the filterable clauses out of the qual list, the ones
+     * the bridge turned down, e.g. because the file's column type differs,
+     * are checked here instead.
+     */
+    foreach(filterCell, filterList)
+    {
+        int searchArgumentIndex = lfirst_int(filterCell);
+
+        if (!filtered[searchArgumentIndex])
+        {
+            recheckList = lappend(recheckList, list_nth(searchArgumentList, searchArgumentIndex));
+        }
+    }
+
+#if PG_VERSION_NUM >= 100000
+    orcState->recheckQual = ExecInitQual(recheckList, (PlanState *) node);
+#else
+    orcState->recheckQual = (List *) ExecInitExpr((Expr *) recheckList, (PlanState *) node);
+#endif
+
+    /* column-major buffers for one orc row batch */
+    orcState->batch.values = (Datum **) palloc(orcState->colNum * sizeof(Datum *));
+    orcState->batch.nulls = (bool **) palloc(orcState->colNum * sizeof(bool *));
+    for(i = 0; i < orcState->colNum; i++) {
+        orcState->batch.values[i] = (Datum *) palloc(MAX_ROW_PER_BATCH * sizeof(Datum));
+        orcState->batch.nulls[i] = (bool *) palloc(MAX_ROW_PER_BATCH * sizeof(bool));
+    }
+    orcState->batch.rowCount = 0;
+    orcState->currentBatch = &orcState->batch;
+    orcState->nextRow = 0;
+
+    /*
+     * The inner side of a nested loop is rescanned over and over. Its decoded
+     * batches are kept, within work_mem, so rescans don't read the file again.
+     * Not if the rescans prune by parameters, each pass reads other stripes.
+     */
+    if ((eflags & EXEC_FLAG_REWIND) && orcState->parameterList == NIL)
+    {
+        orcState->rescanContext = AllocSetContextCreate(orcState->orcContext, "orc_fdw rescan context",
+                                                        ALLOCSET_DEFAULT_MINSIZE,
+                                                        ALLOCSET_DEFAULT_INITSIZE,
+                                                        ALLOCSET_DEFAULT_MAXSIZE);
+        orcState->keeping = true;
+    }
+
+    MemoryContextSwitchTo(oldcontext);
+
+    node->fdw_state = (void *) orcState;
+}
+
+/*
+ * fileIterateForeignScan
+ *		Read next record from the data file and store it into the
+ *		ScanTupleSlot as a virtual tuple
+ */
+static TupleTableSlot *
+fileIterateForeignScan(ForeignScanState *node)
+{
+    OrcExeState *orcState = (OrcExeState *) node->fdw_state;
+    TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+    bool		found;
+    /*
+     * The protocol for loading a virtual tuple into a slot is first
+     * ExecClearTuple, then fill the values/isnull arrays, then
+     * ExecStoreVirtualTuple.  If we don't find another row in the file, we
+     * just skip the last step, leaving the slot empty as required.
+     *
+     * We can pass ExprContext = NULL because we read all columns from the
+     * file, so no need to evaluate default expressions.
+     *
+     * We can also pass tupleOid = NULL because we don't allow oids for
+     * foreign tables.
+     */
+    ExecClearTuple(slot);
+
+    if (orcState->aggregates != NULL)
+    {
+        return OrcIterateAggregates(node);
+    }
+
+    //TupleDesc tupledes = slot->tts_tupleDescriptor;
+    TupleDesc tupledes = orcState->tupleDescriptor;
+    int colNum = tupledes->natts;
+
+    Datum *columnValues = slot->tts_values;
+    bool *columnNulls = slot->tts_isnull;
+    OrcBatch *batch = NULL;
+    ExprContext *econtext = node->ss.ps.ps_ExprContext;
+    unsigned int row;
+    unsigned int i;
+
+    if (orcState->parametersPending)
+    {
+        OrcApplyParameters(node);
+    }
+
+    /* a null parameter, the join clause can't be true */
+    if (orcState->parameterIsNull)
+    {
+        return slot;
+    }
+
+    for (;;) {
+        /* all rows of the current batch returned, fetch the next one */
+        if (orcState->nextRow >= orcState->currentBatch->rowCount) {
+            found = OrcNextBatch(orcState);
+            if (!found)
+                return slot;
+        }
+
+        batch = orcState->currentBatch;
+
+        row = orcState->nextRow++;
+        for(i = 0; i < colNum; i++) {
+            columnValues[i] = batch->values[i][row];
+            columnNulls[i] = batch->nulls[i][row];
+        }
+
+        ExecStoreVirtualTuple(slot);
+
+        if (orcState->recheckQual == NULL)
+            return slot;
+
+        /* clauses the planner left to the bridge but it couldn't filter on */
+        econtext->ecxt_scantuple = slot;
+        ResetExprContext(econtext);
+#if PG_VERSION_NUM >= 100000
+        if (ExecQual(orcState->recheckQual, econtext))
+#else
+        if (ExecQual(orcState->recheckQual, econtext, false))
+#endif
+            return slot;
+
+        ExecClearTuple(slot);
+    }
+}
+
+/*
+ * OrcBeginAggregateScan sets up a scan that returns the aggregates computed
+ * by the bridge instead of rows. The file is only read once the row is asked
+ * for.
+ */
+static void
+OrcBeginAggregateScan(ForeignScanState *node, OrcExeState *orcState)
+{
+    ForeignScan *foreignScan = (ForeignScan *) node->ss.ps.plan;
+    List *foreignPrivateList = (List *) foreignScan->fdw_private;
+    List *aggregateList = (List *) list_nth(foreignPrivateList, OrcScanPrivateAggregateList);
+    List *relationList = (List *) list_nth(foreignPrivateList, OrcScanPrivateAggregateRelation);
+    List *searchArgumentList = (List *) list_nth(foreignPrivateList, OrcScanPrivateSearchArgument);
+    ListCell *aggregateCell = NULL;
+    struct stat statBuffer;
+    int aggregateIndex = 0;
+
+    orcState->colNum = lsecond_int(relationList);
+    orcState->aggregateCount = list_length(aggregateList);
+    orcState->aggregates = OrcAggregateArray(aggregateList);
+    orcState->aggregateTypes = (Oid *) palloc(Max(1, orcState->aggregateCount) * sizeof(Oid));
+    foreach(aggregateCell, aggregateList)
+    {
+        orcState->aggregateTypes[aggregateIndex++] = (Oid) lfourth_int((List *) lfirst(aggregateCell));
+    }
+
+    orcState->aggregateArgument = OrcBuildSearchArgument(searchArgumentList, linitial_int(relationList),
+                                                         NULL, 0);
+
+    /* the tail the planner read, or else the cached one, if the file hasn't changed */
+    if (stat(orcState->filename, &statBuffer) == 0)
+    {
+        orcState->fileTail = OrcPlanFileTail(foreignPrivateList, &statBuffer, &orcState->fileTailLength);
+        if (orcState->fileTail == NULL)
+        {
+            orcState->fileTail = OrcTailCacheLookup(orcState->filename, &statBuffer,
+                                                    &orcState->fileTailLength);
+        }
+    }
+}
+
+/*
+ * OrcIterateAggregates returns the row of the aggregates, computed on the
+ * first call and kept for rescans.
+ */
 static TupleTableSlot *
-simIterateForeignScan(ForeignScanState *node)
+OrcIterateAggregates(ForeignScanState *node)
+{
+    OrcExeState *orcState = (OrcExeState *) node->fdw_state;
+    TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+    int aggregateIndex = 0;
+
+    if (orcState->aggregateReturned)
+    {
+        return slot;
+    }
+
+    if (orcState->aggregateValues == NULL)
+    {
+        MemoryContext oldcontext = MemoryContextSwitchTo(orcState->orcContext);
+
+        computeOrcAggregates(orcState->filename, orcState->colNum, orcState->aggregateArgument,
+                             orcState->fileTail, orcState->fileTailLength,
+                             orcState->aggregates, orcState->aggregateCount, &orcState->aggregateStats);
+
+        orcState->aggregateValues = (Datum *) palloc(Max(1, orcState->aggregateCount) * sizeof(Datum));
+        orcState->aggregateNulls = (bool *) palloc(Max(1, orcState->aggregateCount) * sizeof(bool));
+        for (aggregateIndex = 0; aggregateIndex < orcState->aggregateCount; aggregateIndex++)
+        {
+            orcState->aggregateValues[aggregateIndex] =
+                OrcAggregateDatum(&orcState->aggregates[aggregateIndex],
+                                  orcState->aggregateTypes[aggregateIndex],
+                                  &orcState->aggregateNulls[aggregateIndex]);
+        }
+
+        MemoryContextSwitchTo(oldcontext);
+    }
+
+    for (aggregateIndex = 0; aggregateIndex < orcState->aggregateCount; aggregateIndex++)
+    {
+        slot->tts_values[aggregateIndex] = orcState->aggregateValues[aggregateIndex];
+        slot->tts_isnull[aggregateIndex] = orcState->aggregateNulls[aggregateIndex];
+    }
+    ExecStoreVirtualTuple(slot);
+    orcState->aggregateReturned = true;
+
+    return slot;
+}
+
+/* OrcAggregateDatum converts the bridge's result to the aggregate's result type */
+static Datum
+OrcAggregateDatum(OrcAggregate *aggregate, Oid resultType, bool *isNull)
+{
+    *isNull = aggregate->isNull;
+    if (aggregate->isNull)
+    {
+        return (Datum) 0;
+    }
+
+    switch (resultType)
+    {
+        case INT2OID:
+            if ((int64) (int16) aggregate->intValue != aggregate->intValue)
+            {
+                ereport(ERROR,
+                        (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                                errmsg("smallint out of range")));
+            }
+            return Int16GetDatum((int16) aggregate->intValue);
+        case INT4OID:
+            if ((int64) (int32) aggregate->intValue != aggregate->intValue)
+            {
+                ereport(ERROR,
+                        (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+                                errmsg("integer out of range")));
+            }
+            return Int32GetDatum((int32) aggregate->intValue);
+        case INT8OID:
+            return Int64GetDatum(aggregate->intValue);
+        case FLOAT4OID:
+            return Float4GetDatum((float4) aggregate->doubleValue);
+        case FLOAT8OID:
+            return Float8GetDatum(aggregate->doubleValue);
+        case TEXTOID:
+            return PointerGetDatum(cstring_to_text_with_len(aggregate->stringValue,
+                                                            (int) aggregate->stringLength));
+        case DATEOID:
+            return DateADTGetDatum((DateADT) aggregate->intValue);
+        case TIMESTAMPOID:
+            return TimestampGetDatum((Timestamp) aggregate->intValue);
+        default:
+            elog(ERROR, "unexpected result type %u of an orc aggregate", resultType);
+    }
+
+    return (Datum) 0;
+}
+
+/*
+ * OrcNextBatch makes the next batch of the scan current, either read from the
+ * file or, on a rescan, one of the batches an earlier pass kept. Returns false
+ * at the end of the scan.
+ */
+static bool
+OrcNextBatch(OrcExeState *orcState)
+{
+    orcState->nextRow = 0;
+
+    if (orcState->replaying)
+    {
+        if (orcState->replayIndex >= orcState->keptBatchCount)
+        {
+            orcState->currentBatch = &orcState->batch;
+            orcState->batch.rowCount = 0;
+            return false;
+        }
+
+        orcState->currentBatch = orcState->keptBatches[orcState->replayIndex++];
+        return true;
+    }
+
+    orcState->currentBatch = &orcState->batch;
+    if (!getOrcNextBatch(orcState->reader, &orcState->batch))
+    {
+        /* the whole file is kept, rescans won't read it again */
+        if (orcState->keeping)
+        {
+            orcState->keeping = false;
+            orcState->replaying = true;
+            orcState->replayIndex = orcState->keptBatchCount;
+        }
+        return false;
+    }
+
+    OrcConvertTextColumns(orcState);
+
+    if (orcState->keeping)
+    {
+        OrcKeepBatch(orcState);
+    }
+
+    return true;
+}
+
+/*
+ * OrcKeepBatch copies the current batch into the rescan context. Once the
+ * kept batches outgrow work_mem they are dropped and the scan reads the
+ * file on every rescan.
+ */
+static void
+OrcKeepBatch(OrcExeState *orcState)
+{
+    OrcBatch *batch = &orcState->batch;
+    TupleDesc tupleDescriptor = orcState->tupleDescriptor;
+    MemoryContext oldcontext = MemoryContextSwitchTo(orcState->rescanContext);
+    OrcBatch *keptBatch = (OrcBatch *) palloc(sizeof(OrcBatch));
+    Size batchSize = sizeof(OrcBatch) + orcState->colNum * (sizeof(Datum *) + sizeof(bool *));
+    unsigned int row;
+    int i;
+
+    keptBatch->rowCount = batch->rowCount;
+    keptBatch->values = (Datum **) palloc(orcState->colNum * sizeof(Datum *));
+    keptBatch->nulls = (bool **) palloc(orcState->colNum * sizeof(bool *));
+
+    for (i = 0; i < orcState->colNum; i++)
+    {
+        Form_pg_attribute attr = TupleDescAttr(tupleDescriptor, i);
+
+        keptBatch->values[i] = (Datum *) palloc(batch->rowCount * sizeof(Datum));
+        keptBatch->nulls[i] = (bool *) palloc(batch->rowCount * sizeof(bool));
+        memcpy(keptBatch->nulls[i], batch->nulls[i], batch->rowCount * sizeof(bool));
+        batchSize += batch->rowCount * (sizeof(Datum) + sizeof(bool));
+
+        for (row = 0; row < batch->rowCount; row++)
+        {
+            Datum value = batch->values[i][row];
+
+            if (attr->attbyval || batch->nulls[i][row])
+            {
+                keptBatch->values[i][row] = value;
+                continue;
+            }
+
+            keptBatch->values[i][row] = datumCopy(value, false, attr->attlen);
+            batchSize += datumGetSize(value, false, attr->attlen);
+        }
+    }
+
+    if (orcState->keptBatchCount == orcState->keptBatchCapacity)
+    {
+        orcState->keptBatchCapacity = Max(16, orcState->keptBatchCapacity * 2);
+        if (orcState->keptBatches == NULL)
+        {
+            orcState->keptBatches = (OrcBatch **) palloc(orcState->keptBatchCapacity * sizeof(OrcBatch *));
+        }
+        else
+        {
+            orcState->keptBatches = (OrcBatch **) repalloc(orcState->keptBatches,
+                                                           orcState->keptBatchCapacity * sizeof(OrcBatch *));
+        }
+    }
+    orcState->keptBatches[orcState->keptBatchCount++] = keptBatch;
+    orcState->keptSize += batchSize;
+
+    MemoryContextSwitchTo(oldcontext);
+
+    if (orcState->keptSize > (Size) work_mem * 1024L)
+    {
+        OrcDropKeptBatches(orcState);
+    }
+}
+
+/* OrcDropKeptBatches frees the kept batches and stops keeping them */
+static void
+OrcDropKeptBatches(OrcExeState *orcState)
+{
+    MemoryContextReset(orcState->rescanContext);
+    orcState->keptBatches = NULL;
+    orcState->keptBatchCount = 0;
+    orcState->keptBatchCapacity = 0;
+    orcState->keptSize = 0;
+    orcState->keeping = false;
+    orcState->replaying = false;
+}
+
+/*
+ * OrcConvertTextColumns runs the input functions of the columns without a
+ * binary converter over the whole batch, so that the results share the
+ * batch's lifetime and iterating rows is only copying Datums.
+ */
+static void
+OrcConvertTextColumns(OrcExeState *orcState)
+{
+    OrcBatch *batch = &orcState->batch;
+    TupleDesc tupledes = orcState->tupleDescriptor;
+    MemoryContext oldcontext;
+    unsigned int row;
+    unsigned int i;
+
+    oldcontext = MemoryContextSwitchTo(orcState->batchContext);
+
+    for(i = 0; i < orcState->colNum; i++) {
+        if(!orcState->textFallback[i])
+            continue;
+
+        for(row = 0; row < batch->rowCount; row++) {
+            if(batch->nulls[i][row])
+                continue;
+
+            batch->values[i][row] = InputFunctionCall(&orcState->in_functions[i],
+                                                      DatumGetCString(batch->values[i][row]),
+                                                      orcState->typioparams[i],
+                                                      TupleDescAttr(tupledes, i)->atttypmod);
+        }
+    }
+
+    MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * fileReScanForeignScan
+ *		Rescan table, possibly with new parameters
+ */
+static void
+fileReScanForeignScan(ForeignScanState *node)
+{
+    OrcExeState *orcState = (OrcExeState *) node->fdw_state;
+
+    /* the aggregates don't change, they are returned again */
+    if (orcState->aggregates != NULL)
+    {
+        orcState->aggregateReturned = false;
+        return;
+    }
+
+    orcState->currentBatch = &orcState->batch;
+    orcState->batch.rowCount = 0;
+    orcState->nextRow = 0;
+
+    /* new outer values, the stripes are pruned again before the next batch */
+    if (orcState->parameterList != NIL && node->ss.ps.chgParam != NULL)
+    {
+        orcState->parametersPending = true;
+    }
+
+    /* every batch was kept by an earlier pass, return them again */
+    if (orcState->replaying)
+    {
+        orcState->replayIndex = 0;
+        return;
+    }
+
+    /* a pass that stopped early kept only part of the batches, start over */
+    if (orcState->keeping)
+    {
+        OrcDropKeptBatches(orcState);
+        orcState->keeping = true;
+    }
+
+    /* the reader and its buffers stay, it just seeks back to the first row */
+    rescanOrcReader(orcState->reader);
+}
+
+/*
+ * fileEndForeignScan
+ *		Finish scanning foreign table and dispose objects used for this scan
+ */
+static void
+fileEndForeignScan(ForeignScanState *node)
+{
+    OrcExeState *orcState = (OrcExeState *) node->fdw_state;
+
+    /* if festate is NULL, we are in EXPLAIN; nothing to do */
+    if (orcState == NULL) {
+        return;
+    }
+
+    /* the reader goes first, its buffers are released with decodeContext */
+    releaseOrcReader(orcState->reader);
+
+    MemoryContextDelete(orcState->orcContext);
+
+
+    pfree(orcState);
+}
+
+#if PG_VERSION_NUM >= 90600
+/*
+ * fileIsForeignScanParallelSafe
+ *		Any backend can read the file, the scan is safe in parallel workers
+ */
+static bool
+fileIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
+{
+    return true;
+}
+
+/*
+ * fileEstimateDSMForeignScan
+ *		Space for the stripe cursor shared by the participants
+ */
+static Size
+fileEstimateDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt)
+{
+    return sizeof(OrcParallelState);
+}
+
+/*
+ * fileInitializeDSMForeignScan
+ *		Set up the stripe cursor, and have the leader claim from it
+ */
+static void
+fileInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt, void *coordinate)
+{
+    OrcParallelState *parallelState = (OrcParallelState *) coordinate;
+
+    pg_atomic_init_u64(&parallelState->nextStripe, 0);
+    fileInitializeWorkerForeignScan(node, NULL, coordinate);
+}
+
+#if PG_VERSION_NUM >= 100000
+/*
+ * fileReInitializeDSMForeignScan
+ *		Rewind the stripe cursor before the participants rescan
+ */
+static void
+fileReInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt, void *coordinate)
+{
+    OrcParallelState *parallelState = (OrcParallelState *) coordinate;
+
+    pg_atomic_write_u64(&parallelState->nextStripe, 0);
+}
+#endif
+
+/*
+ * fileInitializeWorkerForeignScan
+ *		Make the scan read only the stripes it claims from the shared cursor
+ */
+static void
+fileInitializeWorkerForeignScan(ForeignScanState *node, shm_toc *toc, void *coordinate)
 {
     OrcExeState *orcState = (OrcExeState *) node->fdw_state;
-    TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
-    bool		found;
 
-    MemoryContext oldcontext = CurrentMemoryContext;
+    if (orcState == NULL || orcState->aggregates != NULL)
+    {
+        return;
+    }
 
-    MemoryContextSwitchTo(orcState->orcContext);
+    /* batches kept for a rescan would hold the stripes of an earlier split */
+    orcState->keeping = false;
 
-    ExecClearTuple(slot);
+    setOrcStripeClaim(orcState->reader, OrcClaimStripe, coordinate);
+}
 
-    //TupleDesc tupledes = slot->tts_tupleDescriptor;
-    TupleDesc tupledes = orcState->tupleDescriptor;
-    int colNum = tupledes->natts;
+/* OrcClaimStripe hands out the stripes of a parallel scan, never raises an error */
+static unsigned long long
+OrcClaimStripe(void *argument)
+{
+    OrcParallelState *parallelState = (OrcParallelState *) argument;
 
+    return (unsigned long long) pg_atomic_fetch_add_u64(&parallelState->nextStripe, 1);
+}
+#endif
 
+/*
+ * fileAnalyzeForeignTable
+ *		Test whether analyzing this foreign table is supported
+ */
+static bool
+fileAnalyzeForeignTable(Relation relation,
+                        AcquireSampleRowsFunc *func,
+                        BlockNumber *totalpages)
+{
+    OrcFdwOptions *options = OrcGetOptions(RelationGetRelid(relation));
+    struct stat statBuffer;
 
+    /* the file is only opened by OrcAcquireSampleRows, a missing one is reported there */
+    if (stat(options->filename, &statBuffer) < 0)
+    {
+        ereport(ERROR,
+                (errcode_for_file_access(),
+                 errmsg("could not stat file \"%s\": %m", options->filename)));
+    }
 
+    *totalpages = (statBuffer.st_size + (BLCKSZ - 1)) / BLCKSZ;
+    if (*totalpages < 1)
+        *totalpages = 1;
 
-    ///Datum *columnValues = slot->tts_values;
-    ///bool *columnNulls = slot->tts_isnull;
-    slot->tts_values = (Datum *) palloc(colNum * sizeof(Datum));
-    slot->tts_isnull = (bool *) palloc(colNum * sizeof(bool));
+    *func = OrcAcquireSampleRows;
 
+    return true;
+}
 
+/*
+ * OrcAcquireSampleRows acquires a random sample of the file's rows for
+ * ANALYZE. The bridge picks blocks of SAMPLE_ROWS_PER_BLOCK rows spread
+ * uniformly over the stripes and converts only those, by the same converters
+ * as a scan's. A stripe is read once, from its first picked block to its
+ * last, the stripes without one aren't read. The blocks hold about targrows
+ * rows, should they hold more the reservoir keeps the sample at targrows.
+ *
+ * The row count is exact, it comes from the footer, and an orc file has no
+ * dead rows. The rows are in file order unless the reservoir replaced some,
+ * so the correlation estimates are about as good as for a heap.
+ */
+static int
+OrcAcquireSampleRows(Relation relation, int elevel,
+                     HeapTuple *rows, int targrows,
+                     double *totalrows, double *totaldeadrows)
+{
+    TupleDesc tupleDescriptor = RelationGetDescr(relation);
+    unsigned int colNum = tupleDescriptor->natts;
+    OrcFdwOptions *options = OrcGetOptions(RelationGetRelid(relation));
+    MemoryContext oldcontext = CurrentMemoryContext;
+    MemoryContext orcContext;
+    MemoryContext batchContext;
+    MemoryContext decodeContext;
+    MemoryContext tupleContext;
+    OrcReaderHandle *reader;
+    OrcBatch batch;
+    Datum *values;
+    bool *nulls;
+    int numrows = 0;
+    double rowsSeen = 0;
+    double rowstoskip = -1;
+    unsigned long long fileRowCount;
+    unsigned int i;
+    unsigned int row;
+#if PG_VERSION_NUM >= 90500
+    ReservoirStateData rstate;
+#else
+    double rstate;
+#endif
+
+    orcContext = AllocSetContextCreate(CurrentMemoryContext, "orc_fdw analyze context",
+                                       ALLOCSET_DEFAULT_MINSIZE,
+                                       ALLOCSET_DEFAULT_INITSIZE,
+                                       ALLOCSET_DEFAULT_MAXSIZE);
+    batchContext = AllocSetContextCreate(orcContext, "orc_fdw batch context",
+                                         ALLOCSET_DEFAULT_MINSIZE,
+                                         ALLOCSET_DEFAULT_INITSIZE,
+                                         ALLOCSET_DEFAULT_MAXSIZE);
+    decodeContext = AllocSetContextCreate(orcContext, "orc_fdw decode context",
+                                          ALLOCSET_DEFAULT_MINSIZE,
+                                          ALLOCSET_DEFAULT_INITSIZE,
+                                          ALLOCSET_DEFAULT_MAXSIZE);
+    /* the text fallback values of one row, reset once its tuple is formed */
+    tupleContext = AllocSetContextCreate(orcContext, "orc_fdw tuple context",
+                                         ALLOCSET_DEFAULT_MINSIZE,
+                                         ALLOCSET_DEFAULT_INITSIZE,
+                                         ALLOCSET_DEFAULT_MAXSIZE);
+
+    MemoryContextSwitchTo(orcContext);
+
+    /* every column is sampled, dropped columns are passed as InvalidOid */
+    Oid *typeIds = (Oid *) palloc(colNum * sizeof(Oid));
+    int32 *typeMods = (int32 *) palloc(colNum * sizeof(int32));
+    bool *projected = (bool *) palloc(colNum * sizeof(bool));
+    bool *textFallback = (bool *) palloc(colNum * sizeof(bool));
+
+    for (i = 0; i < colNum; i++)
+    {
+        Form_pg_attribute attr = TupleDescAttr(tupleDescriptor, i);
 
+        typeIds[i] = attr->attisdropped ? InvalidOid : attr->atttypid;
+        typeMods[i] = attr->atttypmod;
+        projected[i] = !attr->attisdropped;
+    }
 
-    /* initialize all values for this row to null */
-    memset(slot->tts_values, 0, colNum * sizeof(Datum));
+    struct stat statBuffer;
+    char *fileTail = NULL;
+    Size fileTailLength = 0;
 
-    /*has next tuple*/
-    char** tmpNextTuple = (char **)palloc(colNum * sizeof(char *));
-    unsigned int i;
-    for (i=0; i<colNum; i++)
+    if (stat(options->filename, &statBuffer) == 0)
     {
-        tmpNextTuple[i] = NULL;
+        fileTail = OrcTailCacheLookup(options->filename, &statBuffer, &fileTailLength);
     }
 
-    if(getOrcNextTuple(orcState->filename, tmpNextTuple)) {
-        memset(slot->tts_isnull, false, colNum * sizeof(bool));
-        found = true;
+    reader = initOrcReader(options->filename, colNum, SAMPLE_ROWS_PER_BLOCK,
+                           typeIds, typeMods, projected, textFallback,
+                           batchContext, decodeContext, fileTail, fileTailLength);
+
+    fileRowCount = setOrcSample(reader, (unsigned long long) targrows, (unsigned int) random());
+
+    FmgrInfo *in_functions = (FmgrInfo *) palloc(colNum * sizeof(FmgrInfo));
+    Oid *typioparams = (Oid *) palloc(colNum * sizeof(Oid));
+    Oid in_func_oid;
+
+    for (i = 0; i < colNum; i++)
+    {
+        if (!textFallback[i])
+            continue;
+
+        getTypeInputInfo(typeIds[i], &in_func_oid, &typioparams[i]);
+        fmgr_info(in_func_oid, &in_functions[i]);
     }
-    else {
-        found = false;
-        memset(slot->tts_isnull, true, colNum * sizeof(bool));
+
+    batch.values = (Datum **) palloc(colNum * sizeof(Datum *));
+    batch.nulls = (bool **) palloc(colNum * sizeof(bool *));
+    for (i = 0; i < colNum; i++)
+    {
+        batch.values[i] = (Datum *) palloc(SAMPLE_ROWS_PER_BLOCK * sizeof(Datum));
+        batch.nulls[i] = (bool *) palloc(SAMPLE_ROWS_PER_BLOCK * sizeof(bool));
     }
+    values = (Datum *) palloc(colNum * sizeof(Datum));
+    nulls = (bool *) palloc(colNum * sizeof(bool));
 
-    //read and fill next line's record
-    for(i = 0; i < colNum; i++) {
-        Datum columnValue = 0;
+#if PG_VERSION_NUM >= 90500
+    reservoir_init_selection_state(&rstate, targrows);
+#else
+    rstate = anl_init_selection_state(targrows);
+#endif
 
-        if(tmpNextTuple[i] != NULL) {
+    while (getOrcNextBatch(reader, &batch))
+    {
+        for (row = 0; row < batch.rowCount; row++)
+        {
+            vacuum_delay_point();
 
-            columnValue = InputFunctionCall(&orcState->in_functions[i],
-                                            tmpNextTuple[i], orcState->typioparams[i],
-                                            tupledes->attrs[i]->atttypmod);
-        }
-        else {
-            slot->tts_isnull[i] = true;
-        }
+            MemoryContextSwitchTo(tupleContext);
 
-        slot->tts_values[i] = columnValue;
-    }
+            for (i = 0; i < colNum; i++)
+            {
+                values[i] = batch.values[i][row];
+                nulls[i] = batch.nulls[i][row];
+
+                if (textFallback[i] && !nulls[i])
+                {
+                    values[i] = InputFunctionCall(&in_functions[i], DatumGetCString(values[i]),
+                                                  typioparams[i], typeMods[i]);
+                }
+            }
 
-    if (found)
-        ExecStoreVirtualTuple(slot);
+            /* the sample outlives this function, it goes to the caller's context */
+            MemoryContextSwitchTo(oldcontext);
 
+            /*
+             * The first targrows rows are taken, the later ones replace
+             * random rows of the sample, see acquire_sample_rows().
+             */
+            if (numrows < targrows)
+            {
+                rows[numrows++] = heap_form_tuple(tupleDescriptor, values, nulls);
+            }
+            else
+            {
+                if (rowstoskip < 0)
+                {
+#if PG_VERSION_NUM >= 90500
+                    rowstoskip = reservoir_get_next_S(&rstate, rowsSeen, targrows);
+#else
+                    rowstoskip = anl_get_next_S(rowsSeen, targrows, &rstate);
+#endif
+                }
+
+                if (rowstoskip <= 0)
+                {
+#if PG_VERSION_NUM >= 150000
+                    int k = (int) (targrows * sampler_random_fract(&rstate.randstate));
+#elif PG_VERSION_NUM >= 90500
+                    int k = (int) (targrows * sampler_random_fract(rstate.randstate));
+#else
+                    int k = (int) (targrows * anl_random_fract());
+#endif
+
+                    Assert(k >= 0 && k < targrows);
+                    heap_freetuple(rows[k]);
+                    rows[k] = heap_form_tuple(tupleDescriptor, values, nulls);
+                }
+
+                rowstoskip -= 1;
+            }
 
-    //clear memory
-    for(i=0; i<colNum; i++) {
-        pfree(tmpNextTuple[i]);
+            rowsSeen += 1;
+            MemoryContextReset(tupleContext);
+        }
     }
-    pfree(tmpNextTuple);
 
+    /* the reader goes first, its buffers are released with decodeContext */
+    releaseOrcReader(reader);
     MemoryContextSwitchTo(oldcontext);
+    MemoryContextDelete(orcContext);
 
-    return slot;
+    *totalrows = (double) fileRowCount;
+    *totaldeadrows = 0;
+
+    ereport(elevel,
+            (errmsg("\"%s\": file contains %.0f rows; %d rows in sample",
+                    RelationGetRelationName(relation),
+                    *totalrows, numrows)));
+
+    return numrows;
 }
 
+
+
 /*
- * fileIterateForeignScan
- *		Read next record from the data file and store it into the
- *		ScanTupleSlot as a virtual tuple
+ * OrcSearchArgumentList returns the restriction clauses, or the parts of them,
+ * which can be checked against orc column statistics.
  */
-static TupleTableSlot *
-fileIterateForeignScan(ForeignScanState *node)
+static List *
+OrcSearchArgumentList(List *restrictInfoList, Index relid)
 {
-    OrcExeState *orcState = (OrcExeState *) node->fdw_state;
-    TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
-    bool		found;
-    /*
-     * The protocol for loading a virtual tuple into a slot is first
-     * ExecClearTuple, then fill the values/isnull arrays, then
-     * ExecStoreVirtualTuple.  If we don't find another row in the file, we
-     * just skip the last step, leaving the slot empty as required.
-     *
-     * We can pass ExprContext = NULL because we read all columns from the
-     * file, so no need to evaluate default expressions.
-     *
-     * We can also pass tupleOid = NULL because we don't allow oids for
-     * foreign tables.
-     */
-    ExecClearTuple(slot);
+    List *searchArgumentList = NIL;
+    ListCell *restrictInfoCell = NULL;
 
-    //TupleDesc tupledes = slot->tts_tupleDescriptor;
-    TupleDesc tupledes = orcState->tupleDescriptor;
-    int colNum = tupledes->natts;
+    foreach(restrictInfoCell, restrictInfoList)
+    {
+        RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(restrictInfoCell);
+        Expr *clause = OrcSearchArgumentClause(restrictInfo->clause, relid);
 
-    Datum *columnValues = slot->tts_values;
-    bool *columnNulls = slot->tts_isnull;
-    /* initialize all values for this row to null */
-    memset(columnValues, 0, colNum * sizeof(Datum));
+        if (clause != NULL)
+        {
+            searchArgumentList = lappend(searchArgumentList, clause);
+        }
+    }
 
-    /*has next tuple*/
-    char** tmpNextTuple = (char **)malloc(colNum * sizeof(char *));
-    unsigned int i;
-    for (i=0; i<colNum; i++)
+    return searchArgumentList;
+}
+
+/* OrcListPosition returns the position of the pointer in the list, or -1 */
+static int
+OrcListPosition(List *list, void *pointer)
+{
+    ListCell *cell = NULL;
+    int position = 0;
+
+    foreach(cell, list)
     {
-        tmpNextTuple[i] = NULL;
+        if (lfirst(cell) == pointer)
+        {
+            return position;
+        }
+        position++;
     }
 
-    if(getOrcNextTuple(orcState->filename, tmpNextTuple)) {
-        memset(columnNulls, false, colNum * sizeof(bool));
-        found = true;
-    }
-    else {
-        found = false;
-        memset(columnNulls, true, colNum * sizeof(bool));
+    return -1;
+}
+
+/*
+ * OrcFilterableClause tells whether the bridge can evaluate the search
+ * argument clause on the raw orc batches, which it does for a single
+ * comparison on an integer, float or date column.
+ */
+static bool
+OrcFilterableClause(Expr *clause, Index relid)
+{
+    Var *column = NULL;
+    Const *constant = NULL;
+    OrcPredicateOp predicateOp;
+    OrcValueKind valueKind;
+
+    if (!IsA(clause, OpExpr) ||
+        !OrcComparisonOperands((OpExpr *) clause, relid, &column, &constant, &predicateOp) ||
+        !OrcValueKindOf(column->vartype, &valueKind))
+    {
+        return false;
     }
 
-    //read and fill next line's record
-    for(i = 0; i < colNum; i++) {
-        Datum columnValue = 0;
+    return valueKind == ORC_VALUE_INT || valueKind == ORC_VALUE_DOUBLE || valueKind == ORC_VALUE_DATE;
+}
+
+/*
+ * OrcSearchArgumentClause returns the part of the clause that can be checked
+ * against orc column statistics, or NULL. Supported are comparisons between a
+ * column and a constant by a btree operator, and AND/OR trees of those. The
+ * unsupported arms of an AND are dropped, which only makes the check looser;
+ * an OR needs all of its arms.
+ */
+static Expr *
+OrcSearchArgumentClause(Expr *clause, Index relid)
+{
+    if (IsA(clause, BoolExpr))
+    {
+        BoolExpr *boolExpr = (BoolExpr *) clause;
+        List *argList = NIL;
+        ListCell *argCell = NULL;
+
+        if (boolExpr->boolop == NOT_EXPR)
+        {
+            return NULL;
+        }
+
+        foreach(argCell, boolExpr->args)
+        {
+            Expr *arg = OrcSearchArgumentClause((Expr *) lfirst(argCell), relid);
 
-        if(tmpNextTuple[i] != NULL) {
+            if (arg != NULL)
+            {
+                argList = lappend(argList, arg);
+            }
+            else if (boolExpr->boolop == OR_EXPR)
+            {
+                return NULL;
+            }
+        }
 
-            columnValue = InputFunctionCall(&orcState->in_functions[i],
-                                                tmpNextTuple[i], orcState->typioparams[i],
-                                                tupledes->attrs[i]->atttypmod);
+        if (argList == NIL)
+        {
+            return NULL;
         }
-        else {
-            slot->tts_isnull[i] = true;
+        else if (list_length(argList) == 1)
+        {
+            return (Expr *) linitial(argList);
+        }
+        else if (boolExpr->boolop == AND_EXPR)
+        {
+            return make_andclause(argList);
+        }
+        else
+        {
+            return make_orclause(argList);
         }
+    }
+    else if (IsA(clause, OpExpr))
+    {
+        Var *column = NULL;
+        Const *constant = NULL;
+        OrcPredicateOp predicateOp;
 
-        slot->tts_values[i] = columnValue;
+        if (OrcComparisonOperands((OpExpr *) clause, relid, &column, &constant, &predicateOp))
+        {
+            return clause;
+        }
     }
 
-    if (found)
-        ExecStoreVirtualTuple(slot);
+    return NULL;
+}
+
+/*
+ * OrcComparisonOperands checks whether opExpr compares a column of the
+ * relation with a non-null constant by one of the <, <=, =, >=, > operators of
+ * the column type's default btree operator family. If so, it returns the
+ * operands and the comparison as seen from the column's side.
+ */
+static bool
+OrcComparisonOperands(OpExpr *opExpr, Index relid, Var **column,
+                      Const **constant, OrcPredicateOp *predicateOp)
+{
+    Node *leftOperand = NULL;
+    Node *rightOperand = NULL;
+    Oid operatorId = opExpr->opno;
+    Oid opclassId = InvalidOid;
+    OrcValueKind columnKind;
+    OrcValueKind constantKind;
+    int strategy = 0;
+
+    if (list_length(opExpr->args) != 2)
+    {
+        return false;
+    }
 
+    leftOperand = (Node *) linitial(opExpr->args);
+    rightOperand = (Node *) lsecond(opExpr->args);
 
-    for(i=0; i<colNum; i++) {
-        free(tmpNextTuple[i]);
+    /* varchar columns are compared as text */
+    if (IsA(leftOperand, RelabelType))
+    {
+        leftOperand = (Node *) ((RelabelType *) leftOperand)->arg;
+    }
+    if (IsA(rightOperand, RelabelType))
+    {
+        rightOperand = (Node *) ((RelabelType *) rightOperand)->arg;
     }
-    free(tmpNextTuple);
 
-    return slot;
+    if (IsA(leftOperand, Var) && IsA(rightOperand, Const))
+    {
+        *column = (Var *) leftOperand;
+        *constant = (Const *) rightOperand;
+    }
+    else if (IsA(leftOperand, Const) && IsA(rightOperand, Var))
+    {
+        /* constant op column, look at it as column commutator constant */
+        operatorId = get_commutator(operatorId);
+        *column = (Var *) rightOperand;
+        *constant = (Const *) leftOperand;
+    }
+    else
+    {
+        return false;
+    }
+
+    if ((*column)->varno != relid || (*column)->varlevelsup != 0 ||
+        (*column)->varattno <= 0 || (*constant)->constisnull || !OidIsValid(operatorId))
+    {
+        return false;
+    }
+
+    if (!OrcValueKindOf((*column)->vartype, &columnKind) ||
+        !OrcValueKindOf((*constant)->consttype, &constantKind) ||
+        columnKind != constantKind)
+    {
+        return false;
+    }
+
+    /* infinities don't survive the shift to orc's 1970 epoch */
+    if ((*constant)->consttype == DATEOID &&
+        DATE_NOT_FINITE(DatumGetDateADT((*constant)->constvalue)))
+    {
+        return false;
+    }
+#if defined(HAVE_INT64_TIMESTAMP) || PG_VERSION_NUM >= 100000
+    if ((*constant)->consttype == TIMESTAMPOID &&
+        TIMESTAMP_NOT_FINITE(DatumGetTimestamp((*constant)->constvalue)))
+    {
+        return false;
+    }
+#endif
+
+    opclassId = GetDefaultOpClass((*column)->vartype, BTREE_AM_OID);
+    if (OidIsValid(opclassId))
+    {
+        strategy = get_op_opfamily_strategy(operatorId, get_opclass_family(opclassId));
+    }
+
+    /* orc string statistics are byte-wise, which only C collation agrees with for ranges */
+    if (columnKind == ORC_VALUE_STRING && strategy != BTEqualStrategyNumber &&
+        !lc_collate_is_c(opExpr->inputcollid))
+    {
+        return false;
+    }
+
+    switch (strategy)
+    {
+        case BTLessStrategyNumber:
+            *predicateOp = ORC_PREDICATE_LT;
+            break;
+        case BTLessEqualStrategyNumber:
+            *predicateOp = ORC_PREDICATE_LE;
+            break;
+        case BTEqualStrategyNumber:
+            *predicateOp = ORC_PREDICATE_EQ;
+            break;
+        case BTGreaterEqualStrategyNumber:
+            *predicateOp = ORC_PREDICATE_GE;
+            break;
+        case BTGreaterStrategyNumber:
+            *predicateOp = ORC_PREDICATE_GT;
+            break;
+        default:
+            return false;
+    }
+
+    return true;
 }
 
 /*
- * fileReScanForeignScan
- *		Rescan table, possibly with new parameters
+ * OrcValueKindOf maps the types whose values can be compared with orc column
+ * statistics to the kind of value the bridge compares them as.
  */
-static void
-fileReScanForeignScan(ForeignScanState *node)
+static bool
+OrcValueKindOf(Oid typeId, OrcValueKind *valueKind)
 {
-    fileEndForeignScan(node);
-    fileBeginForeignScan(node, 0);
+    switch (typeId)
+    {
+        case INT2OID:
+        case INT4OID:
+        case INT8OID:
+            *valueKind = ORC_VALUE_INT;
+            return true;
+        case FLOAT4OID:
+        case FLOAT8OID:
+            *valueKind = ORC_VALUE_DOUBLE;
+            return true;
+        case TEXTOID:
+        case VARCHAROID:
+            *valueKind = ORC_VALUE_STRING;
+            return true;
+        case DATEOID:
+            *valueKind = ORC_VALUE_DATE;
+            return true;
+#if defined(HAVE_INT64_TIMESTAMP) || PG_VERSION_NUM >= 100000
+        case TIMESTAMPOID:
+            *valueKind = ORC_VALUE_TIMESTAMP;
+            return true;
+#endif
+        default:
+            return false;
+    }
 }
 
 /*
- * fileEndForeignScan
- *		Finish scanning foreign table and dispose objects used for this scan
+ * OrcBuildSearchArgument turns the clauses picked by OrcSearchArgumentList
+ * into the bridge's predicate tree, an AND of all of them followed by the
+ * comparisons with the join parameters. Returns NULL if there is nothing to
+ * check.
+ */
+static OrcPredicate *
+OrcBuildSearchArgument(List *clauseList, Index relid, OrcPredicate *parameters, int parameterCount)
+{
+    OrcPredicate *root = NULL;
+    ListCell *clauseCell = NULL;
+    int childIndex = 0;
+
+    if (clauseList == NIL && parameterCount == 0)
+    {
+        return NULL;
+    }
+
+    root = (OrcPredicate *) palloc0(sizeof(OrcPredicate));
+    root->op = ORC_PREDICATE_AND;
+    root->childCount = list_length(clauseList) + parameterCount;
+    root->children = (OrcPredicate *) palloc0(root->childCount * sizeof(OrcPredicate));
+
+    foreach(clauseCell, clauseList)
+    {
+        OrcBuildPredicate((Expr *) lfirst(clauseCell), relid, &root->children[childIndex++]);
+    }
+
+    if (parameterCount > 0)
+    {
+        memcpy(&root->children[childIndex], parameters, parameterCount * sizeof(OrcPredicate));
+    }
+
+    return root;
+}
+
+/*
+ * OrcApplyParameters evaluates the outer side of the join clauses of a
+ * parameterized scan and sets the search argument to the restriction clauses
+ * and the equalities with these values, before the scan reads its first row.
  */
 static void
-fileEndForeignScan(ForeignScanState *node)
+OrcApplyParameters(ForeignScanState *node)
 {
-    count = 0;//just for testing
     OrcExeState *orcState = (OrcExeState *) node->fdw_state;
+    ForeignScan *foreignScan = (ForeignScan *) node->ss.ps.plan;
+    ExprContext *econtext = node->ss.ps.ps_ExprContext;
+    MemoryContext oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+    int parameterCount = list_length(orcState->parameterList);
+    OrcPredicate *parameters = (OrcPredicate *) palloc0(parameterCount * sizeof(OrcPredicate));
+    bool *filtered = (bool *) palloc0((list_length(orcState->searchArgumentList) + parameterCount + 1) *
+                                      sizeof(bool));
+    ListCell *parameterCell = NULL;
+    ListCell *exprCell = NULL;
+    int parameterIndex = 0;
+
+    orcState->parametersPending = false;
+    orcState->parameterIsNull = false;
+
+    forboth(parameterCell, orcState->parameterList, exprCell, orcState->parameterExprs)
+    {
+        List *parameter = (List *) lfirst(parameterCell);
+        ExprState *exprState = (ExprState *) lfirst(exprCell);
+        OrcPredicate *predicate = &parameters[parameterIndex++];
+        bool isNull = false;
+#if PG_VERSION_NUM >= 100000
+        Datum value = ExecEvalExpr(exprState, econtext, &isNull);
+#else
+        Datum value = ExecEvalExpr(exprState, econtext, &isNull, NULL);
+#endif
+
+        if (isNull)
+        {
+            orcState->parameterIsNull = true;
+            break;
+        }
 
-    /* if festate is NULL, we are in EXPLAIN; nothing to do */
-    if (orcState == NULL) {
-        return;
+        predicate->op = ORC_PREDICATE_EQ;
+        predicate->column = linitial_int(parameter) - 1;
+        OrcSetPredicateValue(predicate, (Oid) lsecond_int(parameter), value);
     }
 
-    /*TODO: clear all file related memory */
-    releaseOrcReader(orcState->filename);
+    /* the bridge copies the tree, the values may go with the per-tuple memory */
+    if (!orcState->parameterIsNull)
+    {
+        setOrcSearchArgument(orcState->reader,
+                             OrcBuildSearchArgument(orcState->searchArgumentList, foreignScan->scan.scanrelid,
+                                                    parameters, parameterCount),
+                             filtered);
+        rescanOrcReader(orcState->reader);
+    }
 
-    //pfree(orcState->nextTuple);
+    MemoryContextSwitchTo(oldcontext);
+}
 
-    MemoryContextDelete(orcState->orcContext);
+static void
+OrcBuildPredicate(Expr *clause, Index relid, OrcPredicate *predicate)
+{
+    if (IsA(clause, BoolExpr))
+    {
+        BoolExpr *boolExpr = (BoolExpr *) clause;
+        ListCell *argCell = NULL;
+        unsigned int childIndex = 0;
 
+        predicate->op = (boolExpr->boolop == AND_EXPR) ? ORC_PREDICATE_AND : ORC_PREDICATE_OR;
+        predicate->childCount = list_length(boolExpr->args);
+        predicate->children = (OrcPredicate *) palloc0(predicate->childCount * sizeof(OrcPredicate));
 
-    pfree(orcState);
+        foreach(argCell, boolExpr->args)
+        {
+            OrcBuildPredicate((Expr *) lfirst(argCell), relid, &predicate->children[childIndex++]);
+        }
+    }
+    else
+    {
+        Var *column = NULL;
+        Const *constant = NULL;
+        bool supported = false;
+
+        /* the clause was accepted by OrcSearchArgumentClause at plan time */
+        supported = OrcComparisonOperands((OpExpr *) clause, relid, &column, &constant, &predicate->op);
+        Assert(supported);
+        (void) supported;
+
+        predicate->column = column->varattno - 1;
+        OrcSetPredicateValue(predicate, constant->consttype, constant->constvalue);
+    }
 }
 
 /*
- * fileAnalyzeForeignTable
- *		Test whether analyzing this foreign table is supported
+ * OrcSetPredicateValue sets the value a comparison predicate compares with,
+ * typeId is one OrcValueKindOf takes. Strings point into the Datum.
  */
-static bool
-fileAnalyzeForeignTable(Relation relation,
-                        AcquireSampleRowsFunc *func,
-                        BlockNumber *totalpages)
+static void
+OrcSetPredicateValue(OrcPredicate *predicate, Oid typeId, Datum value)
 {
-    return false;
-}
+    OrcValueKindOf(typeId, &predicate->kind);
 
+    switch (typeId)
+    {
+        case INT2OID:
+            predicate->intValue = DatumGetInt16(value);
+            break;
+        case INT4OID:
+            predicate->intValue = DatumGetInt32(value);
+            break;
+        case INT8OID:
+            predicate->intValue = DatumGetInt64(value);
+            break;
+        case FLOAT4OID:
+            predicate->doubleValue = DatumGetFloat4(value);
+            break;
+        case FLOAT8OID:
+            predicate->doubleValue = DatumGetFloat8(value);
+            break;
+        case TEXTOID:
+        case VARCHAROID:
+        {
+            text *string = DatumGetTextPP(value);
 
+            predicate->stringValue = VARDATA_ANY(string);
+            predicate->stringLength = VARSIZE_ANY_EXHDR(string);
+            break;
+        }
+        case DATEOID:
+            predicate->intValue = DatumGetDateADT(value);
+            break;
+#if defined(HAVE_INT64_TIMESTAMP) || PG_VERSION_NUM >= 100000
+        case TIMESTAMPOID:
+            predicate->intValue = DatumGetTimestamp(value);
+            break;
+#endif
+        default:
+            break;
+    }
+}
 
 /*
  * ColumnList takes in the planner's information about this foreign table. The
@@ -735,16 +3079,18 @@ ColumnList(RelOptInfo *baserel, Oid foreignTableId)
     List *neededColumnList = NIL;
     AttrNumber columnIndex = 1;
     AttrNumber columnCount = baserel->max_attr;
-    List *targetColumnList = baserel->reltargetlist;
     List *restrictInfoList = baserel->baserestrictinfo;
     ListCell *restrictInfoCell = NULL;
     const AttrNumber wholeRow = 0;
-    Relation relation = heap_open(foreignTableId, AccessShareLock);
+    Relation relation = table_open(foreignTableId, AccessShareLock);
     TupleDesc tupleDescriptor = RelationGetDescr(relation);
-    Form_pg_attribute *attributeFormArray = tupleDescriptor->attrs;
 
     /* first add the columns used in joins and projections */
-    neededColumnList = list_copy(targetColumnList);
+#if PG_VERSION_NUM >= 90600
+    neededColumnList = pull_var_clause((Node *) baserel->reltarget->exprs, PVC_RECURSE_PLACEHOLDERS);
+#else
+    neededColumnList = list_copy(baserel->reltargetlist);
+#endif
 
     /* then walk over all restriction clauses, and pull up any used columns */
     foreach(restrictInfoCell, restrictInfoList)
@@ -754,9 +3100,14 @@ ColumnList(RelOptInfo *baserel, Oid foreignTableId)
         List *clauseColumnList = NIL;
 
         /* recursively pull up any columns used in the restriction clause */
+#if PG_VERSION_NUM >= 90600
+        clauseColumnList = pull_var_clause(restrictClause,
+                                           PVC_RECURSE_AGGREGATES | PVC_RECURSE_PLACEHOLDERS);
+#else
         clauseColumnList = pull_var_clause(restrictClause,
                                            PVC_RECURSE_AGGREGATES,
                                            PVC_RECURSE_PLACEHOLDERS);
+#endif
 
         neededColumnList = list_union(neededColumnList, clauseColumnList);
     }
@@ -778,7 +3129,7 @@ ColumnList(RelOptInfo *baserel, Oid foreignTableId)
             }
             else if (neededColumn->varattno == wholeRow)
             {
-                Form_pg_attribute attributeForm = attributeFormArray[columnIndex - 1];
+                Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex - 1);
                 Index tableId = neededColumn->varno;
 
                 column = makeVar(tableId, columnIndex, attributeForm->atttypid,
@@ -794,7 +3145,7 @@ ColumnList(RelOptInfo *baserel, Oid foreignTableId)
         }
     }
 
-    heap_close(relation, AccessShareLock);
+    table_close(relation, AccessShareLock);
 
     return columnList;
 }
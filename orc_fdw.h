@@ -6,14 +6,22 @@
 #define ORC_FDW_H
 
 #include "fmgr.h"
+#include "nodes/execnodes.h"
+#if PG_VERSION_NUM >= 90600
+#include "port/atomics.h"
+#endif
+#include "storage/block.h"
+#include "orcLibBridge.h"
 
 #define MYLOGFILE "/usr/pgsql-9.4/mylog.txt"
-#define SIM_PAGES 50000// one page = 4kb, 200mb file = 50000 pages
 #define ORC_TUPLE_COST_MULTIPLIER 10
 #define MAX_ROW_PER_BATCH 1000
+/* rows ANALYZE reads per sampled block, each block costs a seek */
+#define SAMPLE_ROWS_PER_BLOCK 100
 
 /* Defines for valid option names */
 #define OPTION_NAME_FILENAME "filename"
+#define OPTION_NAME_SORTED_BY "sorted_by"
 
 extern FILE * logfile;
 
@@ -36,25 +44,84 @@ typedef struct OrcValidOption
 } OrcValidOption;
 
 /* Array of options that are valid for orc_fdw */
-static const uint32 ValidOptionCount = 1;//temporary
+static const uint32 ValidOptionCount = 2;//temporary
 static const OrcValidOption ValidOptionArray[] =
         {
                 /* foreign table options */
-                { OPTION_NAME_FILENAME, ForeignTableRelationId }
+                { OPTION_NAME_FILENAME, ForeignTableRelationId },
+                { OPTION_NAME_SORTED_BY, ForeignTableRelationId }
                 //may add more in the fututre, compressionType etc.
         };
 
-/* initialized in fileGetForeignRelSize, stored as baserel->fdw_private = (void *) OrcFdwOptions;
- * can be used only parameters has RelOptInfo *baserel*/
+/*
+ * Indexes of the items in ForeignScan->fdw_private, which is built by
+ * fileGetForeignPlan and read by fileBeginForeignScan.
+ */
+enum OrcScanPrivateIndex
+{
+    /* Vars of the columns used by the query, only those are read from the file */
+    OrcScanPrivateColumnList,
+    /* restriction clauses checked against the stripe statistics */
+    OrcScanPrivateSearchArgument,
+    /* positions in the search argument of the clauses left out of the qual list */
+    OrcScanPrivateFilterList,
+    /* the file, its serialized tail (bytea Const, null if not read) and the
+     * inode, size and mtime (int8 Consts) it was read at */
+    OrcScanPrivateFilename,
+    OrcScanPrivateFileTail,
+    OrcScanPrivateFileStat,
+    /* per join parameter in fdw_exprs, the column's attnum and the parameter's
+     * type, which the stripes are pruned by on every rescan */
+    OrcScanPrivateParameterList,
+    /* fdw column index the stripes ascend by (Integer), -1 if none */
+    OrcScanPrivateSortColumn,
+    /* aggregate scans only, NIL otherwise: per entry of fdw_scan_tlist the
+     * aggregate kind, fdw column, value kind and result type, and the base
+     * relation's relid and column count */
+    OrcScanPrivateAggregateList,
+    OrcScanPrivateAggregateRelation
+};
+
+/* read from the foreign table's options */
 typedef struct OrcFdwOptions
 {
     char *filename;
+    char *sortedBy;             /* comma-separated columns, NULL if not given */
     //these 3 are defined in cstore
     //CompressionType compressionType;
     //uint64 stripeRowCount;
     //uint32 blockRowCount;
 } OrcFdwOptions;
 
+/* initialized in fileGetForeignRelSize, stored as baserel->fdw_private = (void *) OrcPlanState;
+ * can be used only parameters has RelOptInfo *baserel*/
+typedef struct OrcPlanState
+{
+    OrcFdwOptions *options;
+    BlockNumber pageCount;      /* from stat() of the file */
+    double tupleCount;          /* from the footer, estimated if it can't be read */
+    bool fileInfoValid;
+    OrcFileInfo fileInfo;
+    double *stripeFraction;     /* per column, see getOrcFileInfo() */
+    List *sortColumnList;       /* attnums of sorted_by that the file agrees with */
+
+    /* the footer read, handed to the executor through the plan */
+    char *fileTail;
+    Size fileTailLength;
+    bool fileStatValid;
+    int64 fileInode;
+    int64 fileSize;
+    int64 fileMtime;
+} OrcPlanState;
+
+#if PG_VERSION_NUM >= 90600
+/* shared by the participants of a parallel scan, in its dynamic shared memory */
+typedef struct OrcParallelState
+{
+    pg_atomic_uint64 nextStripe;    /* the next stripe to claim */
+} OrcParallelState;
+#endif
+
 /* initialized in BeginForeignScan, stored as node->fdw_state = (void *) orcState; */
 typedef struct OrcExeState
 {
@@ -62,17 +129,59 @@ typedef struct OrcExeState
     // hdfsfile * should be added later
     char       *filename;
     int         colNum;//number of columns
+    OrcReaderHandle *reader;    /* this scan's reader, from initOrcReader() */
 
     //other
     FmgrInfo   *in_functions;	/* array of input functions for each attrs */
     Oid		   *typioparams;	/* array of element types for in_functions */
-
-    char        **nextTuple;
+    bool       *textFallback;	/* columns without binary converter, need in_functions */
 
     List *queryRestrictionList; /* init in BeginForeignScan */
     TupleDesc tupleDescriptor;
 
+    /* join parameters of a parameterized scan, see OrcApplyParameters() */
+    List *searchArgumentList;
+    List *parameterList;
+    List *parameterExprs;
+    bool parametersPending;     /* to be applied before the next batch */
+    bool parameterIsNull;       /* no row can match */
+
+    /* clauses left out of the qual list which the bridge couldn't filter on */
+#if PG_VERSION_NUM >= 100000
+    ExprState *recheckQual;
+#else
+    List *recheckQual;
+#endif
+
+    /* aggregate scans, which return one row computed by the bridge */
+    OrcAggregate *aggregates;   /* NULL for row scans */
+    int aggregateCount;
+    Oid *aggregateTypes;
+    OrcPredicate *aggregateArgument;
+    char *fileTail;
+    Size fileTailLength;
+    Datum *aggregateValues;     /* NULL until computed, rescans return them again */
+    bool *aggregateNulls;
+    bool aggregateReturned;
+    OrcAggregateStats aggregateStats;
+
+    OrcBatch batch;             /* converted rows of the current orc row batch */
+    OrcBatch *currentBatch;     /* batch rows are returned from, batch or a kept one */
+    unsigned int nextRow;       /* next row of currentBatch to return */
+
+    /* batches kept for rescans, see OrcKeepBatch() */
+    MemoryContext rescanContext; /* NULL if the scan isn't expected to be rescanned */
+    OrcBatch **keptBatches;
+    int keptBatchCount;
+    int keptBatchCapacity;
+    Size keptSize;
+    bool keeping;               /* copying the batches of this pass */
+    bool replaying;             /* returning keptBatches instead of reading the file */
+    int replayIndex;
+
     MemoryContext orcContext;
+    MemoryContext batchContext; /* by-reference values of batch, reset per batch */
+    MemoryContext decodeContext; /* orc lib's memory pool, child of orcContext */
 
 } OrcExeState;
 
@@ -0,0 +1,78 @@
+--
+-- orc_fdw
+--
+
+-- the files of testDataFile/, found from the directory the tests run in
+\set test_data1 `pwd` '/testDataFile/test_data1.orc'
+\set city `pwd` '/testDataFile/city.orc'
+SET datestyle = 'ISO, YMD';
+CREATE EXTENSION orc_fdw;
+CREATE SERVER orc_server FOREIGN DATA WRAPPER orc_fdw;
+-- a foreign table needs its file, and takes no other options
+CREATE FOREIGN TABLE no_file (id int) SERVER orc_server;
+CREATE FOREIGN TABLE bad_option (id int) SERVER orc_server OPTIONS (filename :'city', format 'orc');
+CREATE FOREIGN TABLE test_data1 (id int, name varchar(20), state char(2), salary float8, birthday date)
+    SERVER orc_server OPTIONS (filename :'test_data1');
+CREATE FOREIGN TABLE city (id int8, name text) SERVER orc_server OPTIONS (filename :'city');
+SELECT * FROM test_data1 ORDER BY id;
+SELECT * FROM city ORDER BY id;
+-- only the referenced columns are read
+SELECT name, birthday FROM test_data1 WHERE state = 'CA' ORDER BY id;
+-- the same columns read as other types, timestamp through the date's text
+CREATE FOREIGN TABLE test_data1_types (id int2, name text, state varchar(2), salary float4, birthday timestamp)
+    SERVER orc_server OPTIONS (filename :'test_data1');
+SELECT * FROM test_data1_types WHERE id IN (1, 2, 17) ORDER BY id;
+-- values longer than varchar(n) are an error, as on input, unless filtered out before
+CREATE FOREIGN TABLE test_data1_short (id int, name varchar(5)) SERVER orc_server OPTIONS (filename :'test_data1');
+SELECT * FROM test_data1_short WHERE id <= 2 ORDER BY id;
+DO $$
+BEGIN
+    PERFORM * FROM test_data1_short;
+EXCEPTION WHEN others THEN
+    RAISE NOTICE '%', regexp_replace(SQLERRM, '".*"', '"test_data1.orc"');
+END
+$$;
+-- EXPLAIN ANALYZE without what varies between runs
+CREATE FUNCTION explain_orc(query text) RETURNS SETOF text LANGUAGE plpgsql AS
+$$
+DECLARE
+    line text;
+BEGIN
+    FOR line IN EXECUTE 'EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF) ' || query LOOP
+        CONTINUE WHEN line ~ '^(Planning|Execution) [Tt]ime';
+        line := regexp_replace(line, 'Orc File: .*', 'Orc File: ...');
+        RETURN NEXT regexp_replace(line, 'Peak Memory \(kB\): \d+', 'Peak Memory (kB): N');
+    END LOOP;
+END
+$$;
+-- the stripe's statistics rule out every row
+SELECT * FROM explain_orc('SELECT * FROM test_data1 WHERE id > 100');
+SELECT * FROM test_data1 WHERE id > 100;
+-- the stripe is read, its rows are filtered before they are converted
+SELECT * FROM explain_orc('SELECT * FROM test_data1 WHERE id > 15');
+SELECT id, name FROM test_data1 WHERE id > 15 ORDER BY id;
+-- what the bridge can't filter is left to the executor
+SELECT * FROM explain_orc('SELECT * FROM test_data1 WHERE name = ''mike''');
+-- the inner side of a nested loop is rescanned for every outer row
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+SET enable_material = off;
+SELECT c.name, t.name FROM city c JOIN test_data1 t ON t.id < c.id ORDER BY c.id, t.id;
+-- the outer value prunes the stripes of every rescan
+SELECT c.name, t.name, t.state FROM city c JOIN test_data1 t ON t.id = c.id ORDER BY c.id;
+SELECT c.name, t.name FROM city c, LATERAL (SELECT name FROM test_data1 WHERE id = c.id * 5) t ORDER BY c.id;
+RESET enable_hashjoin;
+RESET enable_mergejoin;
+RESET enable_material;
+-- answered from the stripe statistics
+SELECT count(*), min(id), max(id), sum(id) FROM test_data1;
+SELECT * FROM explain_orc('SELECT count(*), min(id), max(id), sum(id) FROM test_data1');
+-- the statistics can't tell which rows match, the stripe is decoded
+SELECT count(*), min(id), max(salary) FROM test_data1 WHERE id > 5;
+SELECT * FROM explain_orc('SELECT count(*), min(id), max(salary) FROM test_data1 WHERE id > 5');
+-- the row count comes from the footer, the sample from the stripes
+ANALYZE VERBOSE test_data1;
+SELECT relpages, reltuples FROM pg_class WHERE relname = 'test_data1';
+SELECT attname, null_frac FROM pg_stats WHERE tablename = 'test_data1' ORDER BY attname;
+\set VERBOSITY terse
+DROP EXTENSION orc_fdw CASCADE;